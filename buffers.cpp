@@ -0,0 +1,255 @@
+#include "buffers.h"
+#include "textures.h"
+#include <iostream>
+
+void setRestartIndex(GLenum indexType)
+{
+    // GL 4.3 derives the restart index from the index type on its own
+    if (GLEW_VERSION_4_3) return;
+    glPrimitiveRestartIndex(indexType == GL_UNSIGNED_SHORT ? 0xFFFF : RESTART_INDEX);
+}
+
+int vertexStride(RenderPath path)
+{
+    // Normal map path keeps only the position in the VBO
+    return path == RenderPath::NORMAL_MAP ? 3 : 6;
+}
+
+// Maps a buffer for writing, invalidating its old contents so frames still drawing from it are never waited on
+static void* mapForWrite(GLenum target, GLuint buffer, GLsizeiptr& capacity, GLsizeiptr size)
+{
+    glBindBuffer(target, buffer);
+    if (size > capacity) {
+        glBufferData(target, size, nullptr, GL_STATIC_DRAW); // Storage only grows
+        capacity = size;
+    }
+    return glMapBufferRange(target, 0, size, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+}
+
+void uploadTerrainMesh(TerrainBuffers& buffers, const TerrainData& data, RenderPath path)
+{
+    int stride = vertexStride(path);
+    size_t vertexCount = static_cast<size_t>(data.width) * data.height;
+    size_t indexCount = gridIndexCount(data.width, data.height);
+    if (data.quantizedHeights.empty()) vertexCount = indexCount = 0; // Generation failed, nothing to draw
+    buffers.vertexCount = static_cast<GLsizei>(vertexCount);
+    buffers.indexCount = static_cast<GLsizei>(indexCount);
+    if (vertexCount == 0) return;
+
+    // Halves the index buffer whenever every vertex is addressable with 16 bits
+    buffers.indexType = vertexCount <= MAX_SHORT_INDEX_VERTICES ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+    GLsizeiptr indexSize = buffers.indexType == GL_UNSIGNED_SHORT ? sizeof(unsigned short) : sizeof(unsigned int);
+
+    glBindVertexArray(buffers.VAO); // Binds VAO object
+
+    // Vertices and indices are generated straight into the mapped buffers, the mesh never exists in
+    // CPU memory. Mapped contents can be lost (e.g. on a display mode change) and are then rewritten.
+    // The 16-bit heights are dequantized into the blocked layout the normal stencil reads
+    BlockedHeightField heights(data.quantizedHeights);
+    bool mapped = true;
+    bool verticesWritten = false;
+    while (mapped && !verticesWritten) {
+        void* vertices = mapForWrite(GL_ARRAY_BUFFER, buffers.VBO, buffers.vertexCapacity, vertexCount * stride * sizeof(float));
+        mapped = vertices != nullptr;
+        if (!mapped) break;
+        writeTerrainVertices(heights, data.heightScale, static_cast<float*>(vertices), path == RenderPath::VERTEX_NORMALS);
+        verticesWritten = glUnmapBuffer(GL_ARRAY_BUFFER) == GL_TRUE;
+    }
+    bool indicesWritten = false;
+    while (mapped && !indicesWritten) {
+        void* indices = mapForWrite(GL_ELEMENT_ARRAY_BUFFER, buffers.EBO, buffers.indexCapacity, indexCount * indexSize);
+        mapped = indices != nullptr;
+        if (!mapped) break;
+        if (buffers.indexType == GL_UNSIGNED_SHORT) writeGridIndices(static_cast<unsigned short*>(indices), data.width, data.height);
+        else writeGridIndices(static_cast<unsigned int*>(indices), data.width, data.height);
+        indicesWritten = glUnmapBuffer(GL_ELEMENT_ARRAY_BUFFER) == GL_TRUE;
+    }
+    if (!mapped) {
+        // The buffers hold no complete mesh, so nothing is drawn from them
+        std::cerr << "Failed to map the terrain buffers, the terrain is not drawn." << std::endl;
+        buffers.vertexCount = buffers.indexCount = 0;
+        return;
+    }
+
+    glBindBuffer(GL_ARRAY_BUFFER, buffers.VBO); // Binds VBO object
+
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, stride * sizeof(float), (void*)0); // Position attribute
+    glEnableVertexAttribArray(0); // Enables vertex attribute
+
+    if (path == RenderPath::VERTEX_NORMALS) {
+        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, stride * sizeof(float), (void*)(3 * sizeof(float))); // Normal attribute
+        glEnableVertexAttribArray(1); // Enables vertex attribute
+    } else {
+        glDisableVertexAttribArray(1); // Normals come from the texture
+    }
+}
+
+GLsizei uploadPatchMesh(GLuint VAO, GLuint VBO, GLuint EBO, int patchSize)
+{
+    // Vertex positions are small integer grid coordinates, 2 bytes per vertex
+    std::vector<unsigned char> grid;
+    for (int z = 0; z <= patchSize; z++) {
+        for (int x = 0; x <= patchSize; x++) {
+            grid.push_back(static_cast<unsigned char>(x));
+            grid.push_back(static_cast<unsigned char>(z));
+        }
+    }
+
+    // Same strips as generateTerrain, 16-bit since the patch is small
+    std::vector<unsigned short> patchIndices(gridIndexCount(patchSize + 1, patchSize + 1));
+    writeGridIndices(patchIndices.data(), patchSize + 1, patchSize + 1);
+
+    glBindVertexArray(VAO);
+
+    glBindBuffer(GL_ARRAY_BUFFER, VBO);
+    glBufferData(GL_ARRAY_BUFFER, grid.size(), grid.data(), GL_STATIC_DRAW);
+
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, patchIndices.size() * sizeof(unsigned short), patchIndices.data(), GL_STATIC_DRAW);
+
+    glVertexAttribIPointer(0, 2, GL_UNSIGNED_BYTE, 2, (void*)0); // Grid coordinate attribute
+    glEnableVertexAttribArray(0);
+    glDisableVertexAttribArray(1);
+
+    return static_cast<GLsizei>(patchIndices.size());
+}
+
+// Number of shared patches needed to cover the heightfield
+static GLsizei patchInstanceCount(const TerrainData& data)
+{
+    if (!hasTerrain(data)) return 0;
+    int patchesX = (data.width - 2) / PATCH_SIZE + 1;
+    int patchesZ = (data.height - 2) / PATCH_SIZE + 1;
+    return patchesX * patchesZ;
+}
+
+void createTerrainBuffers(TerrainBuffers& buffers, const TerrainData& data, RenderPath path)
+{
+    // Without buffer storage every update goes through glBufferSubData instead
+    if (!buffers.stream.create(STREAM_REGION_SIZE))
+        std::cout << "Persistent mapping unavailable, streaming with glBufferSubData" << std::endl;
+
+    if (path == RenderPath::CHUNKED) {
+        // Chunks live in a pooled VBO/EBO instead of the per-terrain buffers
+        buffers.useChunks = true;
+        createChunkedTerrain(buffers.chunked, data, buffers.stream);
+        return;
+    }
+
+    glGenVertexArrays(1, &buffers.VAO); // Generates 1 VAO object
+    glGenBuffers(1, &buffers.VBO); // Generates 1 VBO object
+    glGenBuffers(1, &buffers.EBO); // Generates 1 EBO object
+
+    if (path == RenderPath::HEIGHT_TEXTURE) {
+        // The patch mesh never changes, only the height texture does
+        buffers.indexCount = uploadPatchMesh(buffers.VAO, buffers.VBO, buffers.EBO, PATCH_SIZE);
+        buffers.vertexCount = (PATCH_SIZE + 1) * (PATCH_SIZE + 1);
+        buffers.indexType = GL_UNSIGNED_SHORT;
+        buffers.heightTexture = createHeightTexture(data.quantizedHeights);
+        buffers.textureWidth = data.width;
+        buffers.textureHeight = data.height;
+        buffers.instanceCount = patchInstanceCount(data);
+        return;
+    }
+
+    if (path == RenderPath::NORMAL_MAP) {
+        buffers.normalMapTexture = createNormalMapTexture(data.normalMap);
+        buffers.textureWidth = data.normalMap.width;
+        buffers.textureHeight = data.normalMap.height;
+    }
+    uploadTerrainMesh(buffers, data, path);
+}
+
+void uploadTerrain(TerrainBuffers& buffers, const TerrainData& data, RenderPath path)
+{
+    if (path == RenderPath::CHUNKED) {
+        uploadChunks(buffers.chunked, data, buffers.stream);
+        return;
+    }
+
+    // Textures keep their storage while the size stays the same
+    bool sameSize = buffers.textureWidth == data.width && buffers.textureHeight == data.height;
+    if (!sameSize) {
+        buffers.textureWidth = data.width;
+        buffers.textureHeight = data.height;
+    }
+
+    if (path == RenderPath::HEIGHT_TEXTURE) {
+        // Regeneration is a single texture upload plus a new instance count
+        if (data.quantizedHeights.empty()) buffers.instanceCount = 0; // Generation failed, nothing to upload
+        else if (sameSize) streamToTexture(buffers.stream, buffers.heightTexture, data.width, data.height, GL_RED, GL_UNSIGNED_SHORT, sizeof(unsigned short), data.quantizedHeights.data());
+        else updateHeightTexture(buffers.heightTexture, data.quantizedHeights);
+        buffers.instanceCount = patchInstanceCount(data);
+        return;
+    }
+
+    uploadTerrainMesh(buffers, data, path);
+    if (path == RenderPath::NORMAL_MAP && !data.normalMap.texels.empty()) {
+        if (sameSize) streamToTexture(buffers.stream, buffers.normalMapTexture, data.width, data.height, GL_RG, GL_UNSIGNED_BYTE, 2, data.normalMap.texels.data());
+        else updateNormalMapTexture(buffers.normalMapTexture, data.normalMap);
+    }
+    buffers.instanceCount = 1;
+}
+
+void drawTerrain(const TerrainBuffers& buffers)
+{
+    if (buffers.useChunks) {
+        drawChunks(buffers.chunked); // One multi-draw for every visible chunk
+        return;
+    }
+
+    glBindVertexArray(buffers.VAO); // Binds VAO object
+    setRestartIndex(buffers.indexType);
+    if (buffers.heightTexture) {
+        glDrawElementsInstanced(GL_TRIANGLE_STRIP, buffers.indexCount, buffers.indexType, 0, buffers.instanceCount); // Draws every patch
+    } else {
+        glDrawElements(GL_TRIANGLE_STRIP, buffers.indexCount, buffers.indexType, 0); // Draws terrain
+    }
+}
+
+void drawTerrainPoints(const TerrainBuffers& buffers)
+{
+    if (buffers.useChunks) {
+        drawChunkPoints(buffers.chunked); // Vertex ranges of the visible chunks
+        return;
+    }
+
+    // No index buffer, so shared vertices are not repeated for each triangle using them
+    glBindVertexArray(buffers.VAO);
+    if (buffers.heightTexture) {
+        glDrawArraysInstanced(GL_POINTS, 0, buffers.vertexCount, buffers.instanceCount); // Patch borders overlap by one row
+    } else {
+        glDrawArrays(GL_POINTS, 0, buffers.vertexCount);
+    }
+}
+
+void finishTerrainFrame(TerrainBuffers& buffers)
+{
+    // Starts a new ring region so the next frame never writes memory the GPU is still reading
+    buffers.stream.advance();
+}
+
+void rescaleTerrain(TerrainBuffers& buffers, TerrainData& data, RenderPath path, float heightScale)
+{
+    data.heightScale = heightScale;
+
+    // The height texture path scales in the vertex shader, so nothing needs uploading
+    if (path == RenderPath::HEIGHT_TEXTURE || !hasTerrain(data)) return;
+
+    // Positions and normals are rebuilt from the cached 16-bit heights, dequantized through the
+    // kernels, no noise is evaluated
+    if (path == RenderPath::NORMAL_MAP) generateNormalMap(BlockedHeightField(data.quantizedHeights), heightScale, data.normalMap);
+    uploadTerrain(buffers, data, path);
+}
+
+void deleteTerrainBuffers(TerrainBuffers& buffers)
+{
+    buffers.stream.destroy();
+    if (buffers.useChunks) deleteChunkedTerrain(buffers.chunked);
+    glDeleteVertexArrays(1, &buffers.VAO);
+    glDeleteBuffers(1, &buffers.VBO);
+    glDeleteBuffers(1, &buffers.EBO);
+    if (buffers.normalMapTexture) glDeleteTextures(1, &buffers.normalMapTexture);
+    if (buffers.heightTexture) glDeleteTextures(1, &buffers.heightTexture);
+    buffers = TerrainBuffers();
+}
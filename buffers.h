@@ -0,0 +1,57 @@
+#pragma once
+#include <GL/glew.h>
+#include <vector>
+#include "terrain.h"
+#include "chunks.h"
+#include "streaming.h"
+
+// Cells per side of the shared grid patch used by the height texture path
+const int PATCH_SIZE = 64;
+
+// GPU-side terrain objects for the active render path
+struct TerrainBuffers {
+    GLuint VAO = 0;
+    GLuint VBO = 0;
+    GLuint EBO = 0;
+    GLuint normalMapTexture = 0; // NORMAL_MAP only
+    GLuint heightTexture = 0;    // HEIGHT_TEXTURE only
+    GLsizei indexCount = 0;      // Indices per draw (per patch for HEIGHT_TEXTURE)
+    GLsizei vertexCount = 0;     // Vertices per draw, used for the point-based normals view
+    GLenum indexType = GL_UNSIGNED_INT; // GL_UNSIGNED_SHORT whenever the vertices fit below the restart index
+    GLsizei instanceCount = 1;   // Patch instances covering the terrain
+    ChunkedTerrain chunked;      // CHUNKED only, owns its own pooled VAO/VBO/EBO
+    bool useChunks = false;
+
+    // Updates are written into a persistently mapped ring and copied on the GPU
+    StreamBuffer stream;
+    GLsizeiptr vertexCapacity = 0; // Allocated VBO bytes, storage is only reallocated when it must grow
+    GLsizeiptr indexCapacity = 0;  // Allocated EBO bytes
+    int textureWidth = 0;          // Allocated size of the height or normal texture
+    int textureHeight = 0;
+};
+
+// Bytes per region of the streaming ring (three regions are allocated)
+const GLsizeiptr STREAM_REGION_SIZE = 4 * 1024 * 1024;
+
+// Creates the buffers and uploads the terrain data
+void createTerrainBuffers(TerrainBuffers& buffers, const TerrainData& data, RenderPath path);
+// Re-uploads regenerated terrain data into the existing objects
+void uploadTerrain(TerrainBuffers& buffers, const TerrainData& data, RenderPath path);
+// Applies a new height scale to the current terrain without regenerating it
+void rescaleTerrain(TerrainBuffers& buffers, TerrainData& data, RenderPath path, float heightScale);
+// Issues the draw call for the terrain with the currently bound program
+void drawTerrain(const TerrainBuffers& buffers);
+// Draws every vertex once as a point, for the normals debug view
+void drawTerrainPoints(const TerrainBuffers& buffers);
+// Fences this frame's streaming writes, called after the last draw of the frame
+void finishTerrainFrame(TerrainBuffers& buffers);
+void deleteTerrainBuffers(TerrainBuffers& buffers);
+
+// Generates the mesh from the heightfield directly into the mapped VBO/EBO and sets the vertex layout
+void uploadTerrainMesh(TerrainBuffers& buffers, const TerrainData& data, RenderPath path);
+// Builds the shared (patchSize + 1)^2 vertex patch and returns its index count
+GLsizei uploadPatchMesh(GLuint VAO, GLuint VBO, GLuint EBO, int patchSize);
+// Sets the strip restart index for the index type, only needed without GL_PRIMITIVE_RESTART_FIXED_INDEX
+void setRestartIndex(GLenum indexType);
+// Number of floats per vertex for the render path
+int vertexStride(RenderPath path);
@@ -0,0 +1,303 @@
+#include "chunks.h"
+#include "buffers.h"
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+Suballocator::Suballocator(GLuint capacity) : total(0)
+{
+    grow(capacity);
+}
+
+bool Suballocator::allocate(GLuint size, GLuint& offset)
+{
+    // First fit keeps allocation order close to address order
+    for (std::map<GLuint, GLuint>::iterator it = freeBlocks.begin(); it != freeBlocks.end(); ++it) {
+        if (it->second < size) continue;
+
+        offset = it->first;
+        GLuint remaining = it->second - size;
+        freeBlocks.erase(it);
+        if (remaining > 0) freeBlocks[offset + size] = remaining;
+        usedBlocks[offset] = size;
+        return true;
+    }
+    return false;
+}
+
+void Suballocator::release(GLuint offset)
+{
+    std::map<GLuint, GLuint>::iterator used = usedBlocks.find(offset);
+    if (used == usedBlocks.end()) return;
+    GLuint size = used->second;
+    usedBlocks.erase(used);
+
+    // Merges with the following free block
+    std::map<GLuint, GLuint>::iterator next = freeBlocks.find(offset + size);
+    if (next != freeBlocks.end()) {
+        size += next->second;
+        freeBlocks.erase(next);
+    }
+
+    // Merges with the preceding free block
+    std::map<GLuint, GLuint>::iterator prev = freeBlocks.lower_bound(offset);
+    if (prev != freeBlocks.begin()) {
+        --prev;
+        if (prev->first + prev->second == offset) {
+            prev->second += size;
+            return;
+        }
+    }
+    freeBlocks[offset] = size;
+}
+
+void Suballocator::grow(GLuint newCapacity)
+{
+    if (newCapacity <= total) return;
+
+    // The new tail is free, merged with a free block ending at the old capacity
+    GLuint offset = total;
+    GLuint size = newCapacity - total;
+    total = newCapacity;
+    if (!freeBlocks.empty()) {
+        std::map<GLuint, GLuint>::iterator last = --freeBlocks.end();
+        if (last->first + last->second == offset) {
+            last->second += size;
+            return;
+        }
+    }
+    freeBlocks[offset] = size;
+}
+
+// Reallocates a pool buffer with a larger size and copies the old contents on the GPU
+static GLuint resizeBuffer(GLuint buffer, GLsizeiptr oldSize, GLsizeiptr newSize)
+{
+    GLuint resized;
+    glGenBuffers(1, &resized);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, resized);
+    glBufferData(GL_COPY_WRITE_BUFFER, newSize, nullptr, GL_STATIC_DRAW);
+    if (buffer) {
+        glBindBuffer(GL_COPY_READ_BUFFER, buffer);
+        if (oldSize > 0) glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, oldSize);
+        glDeleteBuffers(1, &buffer);
+    }
+    return resized;
+}
+
+// Grows the pool so that at least the given number of vertices and indices fit
+static void growPool(GeometryPool& pool, GLuint vertexCapacity, GLuint indexCapacity)
+{
+    if (vertexCapacity > pool.vertices.capacity()) {
+        pool.VBO = resizeBuffer(pool.VBO, pool.vertices.capacity() * 6 * sizeof(float), vertexCapacity * 6 * sizeof(float));
+        pool.vertices.grow(vertexCapacity);
+    }
+    if (indexCapacity > pool.indices.capacity()) {
+        pool.EBO = resizeBuffer(pool.EBO, pool.indices.capacity() * sizeof(unsigned short), indexCapacity * sizeof(unsigned short));
+        pool.indices.grow(indexCapacity);
+    }
+
+    // Re-points the VAO at the (possibly new) buffers
+    glBindVertexArray(pool.VAO);
+    glBindBuffer(GL_ARRAY_BUFFER, pool.VBO);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, pool.EBO);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (void*)0); // Position attribute
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (void*)(3 * sizeof(float))); // Normal attribute
+    glEnableVertexAttribArray(1);
+}
+
+// Suballocates a block, growing the pool when the free list has no room
+static GLuint allocateOrGrow(GeometryPool& pool, Suballocator& allocator, GLuint size, bool vertices)
+{
+    GLuint offset;
+    while (!allocator.allocate(size, offset)) {
+        GLuint grown = std::max(allocator.capacity() * 2, allocator.capacity() + size);
+        if (vertices) growPool(pool, grown, pool.indices.capacity());
+        else growPool(pool, pool.vertices.capacity(), grown);
+    }
+    return offset;
+}
+
+// Lets write() fill size bytes straight in the mapped ring, or in scratch memory without one, then
+// copies them into place on the GPU
+template <typename Writer>
+static void writeThroughStream(StreamBuffer& stream, std::vector<unsigned char>& scratch, GLuint destination, GLintptr destinationOffset, GLsizeiptr size, Writer write)
+{
+    GLintptr streamOffset;
+    void* target = stream.valid() ? stream.allocate(size, streamOffset) : nullptr;
+    if (target) {
+        write(target);
+        copyFromStream(stream, streamOffset, destination, destinationOffset, size);
+        return;
+    }
+    scratch.resize(size);
+    write(scratch.data());
+    streamToBuffer(stream, destination, destinationOffset, scratch.data(), size);
+}
+
+void createChunkedTerrain(ChunkedTerrain& terrain, const TerrainData& data, StreamBuffer& stream)
+{
+    glGenVertexArrays(1, &terrain.pool.VAO);
+    glGenBuffers(1, &terrain.indirectBuffer);
+
+    // One draw for all visible chunks needs GL 4.3 (available in llvmpipe)
+    terrain.multiDrawIndirect = GLEW_VERSION_4_3 || GLEW_ARB_multi_draw_indirect;
+    if (!terrain.multiDrawIndirect)
+        std::cout << "Multi-draw indirect unavailable, falling back to one draw per chunk" << std::endl;
+
+    // Sized for the initial terrain so the first upload does not need to grow
+    GLuint vertexCapacity = static_cast<GLuint>(data.width * data.height) * 11 / 10 + 1;
+    GLuint indexCapacity = static_cast<GLuint>(gridIndexCount(data.width, data.height)) * 3 / 2 + 1; // Chunk-sized bands restart strips more often
+    growPool(terrain.pool, vertexCapacity, indexCapacity);
+
+    uploadChunks(terrain, data, stream);
+}
+
+void uploadChunks(ChunkedTerrain& terrain, const TerrainData& data, StreamBuffer& stream)
+{
+    GeometryPool& pool = terrain.pool;
+
+    // Returns every previous chunk to the free lists
+    for (size_t i = 0; i < terrain.chunks.size(); i++) {
+        pool.vertices.release(terrain.chunks[i].baseVertex);
+        pool.indices.release(terrain.chunks[i].firstIndex);
+    }
+    terrain.chunks.clear();
+    terrain.commands.clear();
+    if (data.tiles.empty()) return;
+    terrain.step = data.tiles[0].step;
+
+    std::vector<unsigned char> scratch;
+    for (size_t t = 0; t < data.tiles.size(); t++) {
+        const HeightTile& tile = data.tiles[t];
+
+        // Chunks share their border vertices with the neighbouring chunk: each one also draws the first
+        // halo row and column, which is the next tile's edge, unless that lies past the end of the grid
+        int chunkWidth = tile.width + (tile.originX + tile.width * tile.step < data.width ? 1 : 0);
+        int chunkDepth = tile.height + (tile.originZ + tile.height * tile.step < data.height ? 1 : 0);
+        if (chunkWidth < 2 || chunkDepth < 2) continue; // A single leftover row or column of samples has no cells
+
+        TerrainChunk chunk;
+        chunk.boundsMin = glm::vec3(static_cast<float>(tile.originX), 1e30f, static_cast<float>(tile.originZ));
+        chunk.boundsMax = glm::vec3(static_cast<float>(tile.originX + (chunkWidth - 1) * tile.step), -1e30f,
+                                    static_cast<float>(tile.originZ + (chunkDepth - 1) * tile.step));
+        for (int z = 0; z < chunkDepth; z++) {
+            for (int x = 0; x < chunkWidth; x++) {
+                float y = tile.at(x, z) * data.heightScale;
+                chunk.boundsMin.y = std::min(chunk.boundsMin.y, y);
+                chunk.boundsMax.y = std::max(chunk.boundsMax.y, y);
+            }
+        }
+
+        // Local 16-bit indices, a chunk has at most 65x65 vertices and the pool offset is applied through baseVertex
+        chunk.vertexCount = static_cast<GLuint>(chunkWidth * chunkDepth);
+        chunk.indexCount = static_cast<GLuint>(gridIndexCount(chunkWidth, chunkDepth));
+        chunk.baseVertex = allocateOrGrow(pool, pool.vertices, chunk.vertexCount, true);
+        chunk.firstIndex = allocateOrGrow(pool, pool.indices, chunk.indexCount, false);
+
+        // Writes the chunk's vertices from its tile straight into its suballocated range
+        writeThroughStream(stream, scratch, pool.VBO, chunk.baseVertex * 6 * sizeof(float), chunk.vertexCount * 6 * sizeof(float), [&](void* target) {
+            writeTileVertices(tile, chunkWidth, chunkDepth, data.heightScale, static_cast<float*>(target), true);
+        });
+        writeThroughStream(stream, scratch, pool.EBO, chunk.firstIndex * sizeof(unsigned short), chunk.indexCount * sizeof(unsigned short), [&](void* target) {
+            writeGridIndices(static_cast<unsigned short*>(target), chunkWidth, chunkDepth);
+        });
+
+        terrain.chunks.push_back(chunk);
+    }
+    terrain.commands.reserve(terrain.chunks.size());
+}
+
+void cullChunks(ChunkedTerrain& terrain, const glm::mat4& viewProjection, StreamBuffer& stream)
+{
+    // Extracts the six frustum planes from the combined matrix (Gribb/Hartmann)
+    glm::vec4 planes[6];
+    for (int i = 0; i < 3; i++) {
+        for (int c = 0; c < 4; c++) {
+            planes[i * 2][c] = viewProjection[c][3] + viewProjection[c][i];
+            planes[i * 2 + 1][c] = viewProjection[c][3] - viewProjection[c][i];
+        }
+    }
+
+    terrain.commands.clear();
+    terrain.pointFirsts.clear();
+    terrain.pointCounts.clear();
+    for (size_t i = 0; i < terrain.chunks.size(); i++) {
+        const TerrainChunk& chunk = terrain.chunks[i];
+
+        // A box is outside when its most positive corner is behind any plane
+        bool visible = true;
+        for (int p = 0; p < 6 && visible; p++) {
+            glm::vec3 corner(planes[p].x >= 0.0f ? chunk.boundsMax.x : chunk.boundsMin.x,
+                             planes[p].y >= 0.0f ? chunk.boundsMax.y : chunk.boundsMin.y,
+                             planes[p].z >= 0.0f ? chunk.boundsMax.z : chunk.boundsMin.z);
+            visible = glm::dot(glm::vec3(planes[p].x, planes[p].y, planes[p].z), corner) + planes[p].w >= 0.0f;
+        }
+        if (!visible) continue;
+
+        DrawElementsIndirectCommand command;
+        command.count = chunk.indexCount;
+        command.instanceCount = 1;
+        command.firstIndex = chunk.firstIndex;
+        command.baseVertex = static_cast<GLint>(chunk.baseVertex);
+        command.baseInstance = 0;
+        terrain.commands.push_back(command);
+        terrain.pointFirsts.push_back(static_cast<GLint>(chunk.baseVertex));
+        terrain.pointCounts.push_back(static_cast<GLsizei>(chunk.vertexCount));
+    }
+
+    if (!terrain.multiDrawIndirect || terrain.commands.empty()) return;
+    GLsizeiptr commandBytes = terrain.commands.size() * sizeof(DrawElementsIndirectCommand);
+
+    // Commands go straight into the persistently mapped ring when one exists
+    GLintptr offset;
+    void* mapped = stream.allocate(commandBytes, offset);
+    if (mapped) {
+        std::memcpy(mapped, terrain.commands.data(), commandBytes);
+        terrain.commandBuffer = stream.id();
+        terrain.commandOffset = offset;
+        return;
+    }
+
+    // Otherwise orphans and refills the indirect buffer with this frame's commands
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, terrain.indirectBuffer);
+    glBufferData(GL_DRAW_INDIRECT_BUFFER, commandBytes, terrain.commands.data(), GL_STREAM_DRAW);
+    terrain.commandBuffer = terrain.indirectBuffer;
+    terrain.commandOffset = 0;
+}
+
+void drawChunks(const ChunkedTerrain& terrain)
+{
+    if (terrain.commands.empty()) return;
+    glBindVertexArray(terrain.pool.VAO);
+    setRestartIndex(GL_UNSIGNED_SHORT);
+
+    if (terrain.multiDrawIndirect) {
+        // Single submission regardless of how many chunks are visible
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, terrain.commandBuffer);
+        glMultiDrawElementsIndirect(GL_TRIANGLE_STRIP, GL_UNSIGNED_SHORT, (void*)terrain.commandOffset, static_cast<GLsizei>(terrain.commands.size()), 0);
+        return;
+    }
+
+    // GL 3.3 fallback with the same command list
+    for (size_t i = 0; i < terrain.commands.size(); i++) {
+        const DrawElementsIndirectCommand& command = terrain.commands[i];
+        glDrawElementsBaseVertex(GL_TRIANGLE_STRIP, command.count, GL_UNSIGNED_SHORT, (void*)(command.firstIndex * sizeof(unsigned short)), command.baseVertex);
+    }
+}
+
+void drawChunkPoints(const ChunkedTerrain& terrain)
+{
+    if (terrain.pointFirsts.empty()) return;
+    glBindVertexArray(terrain.pool.VAO);
+    glMultiDrawArrays(GL_POINTS, terrain.pointFirsts.data(), terrain.pointCounts.data(), static_cast<GLsizei>(terrain.pointFirsts.size()));
+}
+
+void deleteChunkedTerrain(ChunkedTerrain& terrain)
+{
+    glDeleteVertexArrays(1, &terrain.pool.VAO);
+    glDeleteBuffers(1, &terrain.pool.VBO);
+    glDeleteBuffers(1, &terrain.pool.EBO);
+    glDeleteBuffers(1, &terrain.indirectBuffer);
+    terrain = ChunkedTerrain();
+}
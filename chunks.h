@@ -0,0 +1,73 @@
+#pragma once
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+#include <map>
+#include <vector>
+#include "terrain.h"
+#include "streaming.h"
+
+// Free-list allocator over a linear range, offsets and sizes are in elements
+class Suballocator {
+public:
+    explicit Suballocator(GLuint capacity = 0);
+
+    bool allocate(GLuint size, GLuint& offset); // First fit, returns false when no block is large enough
+    void release(GLuint offset);                // Returns a block and merges it with free neighbours
+    void grow(GLuint newCapacity);              // Extends the range, the new tail becomes free
+    GLuint capacity() const { return total; }
+
+private:
+    GLuint total;
+    std::map<GLuint, GLuint> freeBlocks; // offset -> size, ordered so neighbours can be merged
+    std::map<GLuint, GLuint> usedBlocks; // offset -> size
+};
+
+// One large VBO/EBO pair shared by every chunk
+struct GeometryPool {
+    GLuint VAO = 0;
+    GLuint VBO = 0;
+    GLuint EBO = 0;
+    Suballocator vertices; // Counted in vertices (6 floats each)
+    Suballocator indices;  // Counted in 16-bit indices
+};
+
+struct TerrainChunk {
+    glm::vec3 boundsMin;  // World-space bounding box for frustum culling
+    glm::vec3 boundsMax;
+    GLuint baseVertex;    // Offset of the chunk's vertices in the pool
+    GLuint vertexCount;
+    GLuint firstIndex;    // Offset of the chunk's indices in the pool
+    GLuint indexCount;
+};
+
+// Layout expected by glMultiDrawElementsIndirect
+struct DrawElementsIndirectCommand {
+    GLuint count;
+    GLuint instanceCount;
+    GLuint firstIndex;
+    GLint baseVertex;
+    GLuint baseInstance;
+};
+
+struct ChunkedTerrain {
+    GeometryPool pool;
+    std::vector<TerrainChunk> chunks;
+    std::vector<DrawElementsIndirectCommand> commands; // Visible chunks for the current frame
+    std::vector<GLint> pointFirsts;   // Vertex ranges of the visible chunks, for the normals debug view
+    std::vector<GLsizei> pointCounts;
+    GLuint indirectBuffer = 0;      // Fallback command buffer when there is no streaming ring
+    GLuint commandBuffer = 0;       // Buffer holding this frame's commands
+    GLintptr commandOffset = 0;     // Byte offset of the commands inside commandBuffer
+    bool multiDrawIndirect = false; // GL 4.3 / ARB_multi_draw_indirect, otherwise one draw per chunk
+    int step = 1;                   // Grid points between chunk vertices, 2^lod of the uploaded tiles
+};
+
+void createChunkedTerrain(ChunkedTerrain& terrain, const TerrainData& data, StreamBuffer& stream);
+// Releases the previous chunks and suballocates one chunk per tile of the regenerated terrain, uploading through the ring
+void uploadChunks(ChunkedTerrain& terrain, const TerrainData& data, StreamBuffer& stream);
+// Writes indirect commands for the chunks inside the view frustum straight into the ring
+void cullChunks(ChunkedTerrain& terrain, const glm::mat4& viewProjection, StreamBuffer& stream);
+void drawChunks(const ChunkedTerrain& terrain);
+// Draws each vertex of the visible chunks once as a point
+void drawChunkPoints(const ChunkedTerrain& terrain);
+void deleteChunkedTerrain(ChunkedTerrain& terrain);
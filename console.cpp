@@ -0,0 +1,106 @@
+#include "console.h"
+#include <iostream>
+#include <sstream>
+#include <thread>
+
+bool parseCommand(const std::string& line, ConsoleCommand& command, std::string& error)
+{
+    std::istringstream stream(line);
+    std::string name;
+    stream >> name;
+
+    if (name == "load") {
+        // The rest of the line is the path, so paths may contain spaces
+        std::getline(stream >> std::ws, command.argument);
+        if (command.argument.empty()) {
+            error = "usage: load <path>";
+            return false;
+        }
+        command.type = CommandType::LOAD;
+    } else if (name == "seed") {
+        if (!(stream >> command.value) || command.value < 0) {
+            error = "usage: seed <non-negative integer>";
+            return false;
+        }
+        command.type = CommandType::SEED;
+    } else if (name == "mode") {
+        stream >> command.argument;
+        if (command.argument != "perlin" && command.argument != "image") {
+            error = "usage: mode perlin|image";
+            return false;
+        }
+        command.type = CommandType::MODE;
+    } else if (name == "engine") {
+        stream >> command.argument;
+        if (command.argument != "perlin" && command.argument != "hash" && command.argument != "simplex" && command.argument != "fixed") {
+            error = "usage: engine perlin|hash|simplex|fixed";
+            return false;
+        }
+        command.type = CommandType::ENGINE;
+    } else if (name == "lod") {
+        if (!(stream >> command.value) || command.value < 0) {
+            error = "usage: lod <level>";
+            return false;
+        }
+        command.type = CommandType::LOD;
+    } else if (name == "height" || name == "noise") {
+        if (!(stream >> command.scale) || !(command.scale > 0.0f)) {
+            error = "usage: " + name + " <positive number>";
+            return false;
+        }
+        command.type = name == "height" ? CommandType::HEIGHT : CommandType::NOISE;
+    } else if (name == "help") {
+        command.type = CommandType::HELP;
+    } else if (name == "quit" || name == "exit") {
+        command.type = CommandType::QUIT;
+    } else {
+        error = "unknown command '" + name + "', type help for a list";
+        return false;
+    }
+    return true;
+}
+
+void printCommandHelp()
+{
+    std::cout << "Console commands:" << std::endl;
+    std::cout << "  load <path>       Load a height map image" << std::endl;
+    std::cout << "  seed <n>          Set the Perlin noise seed (0 = random)" << std::endl;
+    std::cout << "  mode perlin|image Switch the generation mode" << std::endl;
+    std::cout << "  engine <name>     Switch the noise implementation: perlin, hash, simplex or fixed" << std::endl;
+    std::cout << "  lod <level>       Set the chunk level of detail (--chunked)" << std::endl;
+    std::cout << "  height <scale>    Rescale the terrain heights without regenerating" << std::endl;
+    std::cout << "  noise <scale>     Set the Perlin noise frequency (regenerates)" << std::endl;
+    std::cout << "  quit              Close the window" << std::endl;
+}
+
+CommandConsole::CommandConsole() : state(std::make_shared<State>())
+{
+    // Detached: a thread blocked in getline cannot be joined, it owns a reference to the state instead
+    std::thread(&CommandConsole::run, state).detach();
+}
+
+CommandConsole::~CommandConsole()
+{
+    state->stopped = true;
+}
+
+void CommandConsole::run(std::shared_ptr<State> state)
+{
+    std::string line;
+    while (!state->stopped && std::getline(std::cin, line)) {
+        if (line.find_first_not_of(" \t\r") == std::string::npos) continue;
+
+        ConsoleCommand command;
+        std::string error;
+        if (!parseCommand(line, command, error)) {
+            std::cerr << error << std::endl;
+        } else if (!state->queue.push(command)) {
+            std::cerr << "Command queue full, dropped: " << line << std::endl;
+        }
+    }
+}
+
+bool CommandConsole::poll(ConsoleCommand& command)
+{
+    return state->queue.pop(command);
+}
@@ -0,0 +1,83 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <utility>
+
+// Single-producer single-consumer ring buffer. The producer only writes tail and the
+// consumer only writes head, so acquire/release ordering is enough and no locks are taken.
+template <typename T, size_t Capacity>
+class SpscQueue {
+public:
+    SpscQueue() : head(0), tail(0) {}
+
+    // Called from the producer thread, returns false when the queue is full
+    bool push(const T& item)
+    {
+        size_t current = tail.load(std::memory_order_relaxed);
+        size_t next = (current + 1) % Capacity;
+        if (next == head.load(std::memory_order_acquire)) return false;
+        slots[current] = item;
+        tail.store(next, std::memory_order_release);
+        return true;
+    }
+
+    // Called from the consumer thread, returns false when the queue is empty
+    bool pop(T& item)
+    {
+        size_t current = head.load(std::memory_order_relaxed);
+        if (current == tail.load(std::memory_order_acquire)) return false;
+        item = std::move(slots[current]);
+        head.store((current + 1) % Capacity, std::memory_order_release);
+        return true;
+    }
+
+private:
+    T slots[Capacity];
+    std::atomic<size_t> head; // Next slot to read
+    std::atomic<size_t> tail; // Next slot to write
+};
+
+enum class CommandType {
+    LOAD,   // load <path>: switch to the height map image at path
+    SEED,   // seed <n>: set the Perlin seed
+    MODE,   // mode perlin|image: switch the generation mode
+    LOD,    // lod <level>: set the chunk level of detail
+    HEIGHT, // height <scale>: rescale the current terrain
+    NOISE,  // noise <scale>: set the Perlin noise frequency
+    ENGINE, // engine perlin|hash|simplex|fixed: switch the noise implementation
+    HELP,
+    QUIT
+};
+
+struct ConsoleCommand {
+    CommandType type = CommandType::HELP;
+    std::string argument; // Path for LOAD, mode name for MODE, engine name for ENGINE
+    long value = 0;       // Number for SEED and LOD
+    float scale = 0.0f;   // Positive number for HEIGHT and NOISE
+};
+
+// Parses one console line, returns false and fills error for invalid input
+bool parseCommand(const std::string& line, ConsoleCommand& command, std::string& error);
+void printCommandHelp();
+
+// Reads commands from stdin on its own thread and posts them to the render thread
+class CommandConsole {
+public:
+    CommandConsole();
+    ~CommandConsole();
+
+    // Called once per frame on the render thread, never blocks
+    bool poll(ConsoleCommand& command);
+
+private:
+    struct State {
+        SpscQueue<ConsoleCommand, 64> queue;
+        std::atomic<bool> stopped{false};
+    };
+
+    static void run(std::shared_ptr<State> state);
+
+    std::shared_ptr<State> state; // Shared with the reader thread, which may outlive the console
+};
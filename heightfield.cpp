@@ -0,0 +1,54 @@
+#include "heightfield.h"
+#include <algorithm>
+#include <cmath>
+#include "kernels.h"
+
+void BlockedHeightField::assign(const QuantizedHeightField& heights)
+{
+    w = heights.width();
+    h = heights.height();
+    blocksX = (w + HEIGHT_BLOCK_SIZE - 1) >> HEIGHT_BLOCK_SHIFT;
+    blocksZ = (h + HEIGHT_BLOCK_SIZE - 1) >> HEIGHT_BLOCK_SHIFT;
+    samples.resize(static_cast<size_t>(blocksX) * blocksZ * HEIGHT_BLOCK_SIZE * HEIGHT_BLOCK_SIZE);
+    if (w <= 0 || h <= 0) return;
+
+    // Each source row lands in blocksX contiguous runs, rows and columns past the grid repeat its edge
+    const Kernels& selected = kernels();
+    for (int z = 0; z < blocksZ * HEIGHT_BLOCK_SIZE; z++) {
+        const unsigned short* row = heights.data() + static_cast<size_t>(std::min(z, h - 1)) * w;
+        for (int bx = 0; bx < blocksX; bx++) {
+            float* out = &samples[index(bx * HEIGHT_BLOCK_SIZE, z)];
+            int x0 = bx * HEIGHT_BLOCK_SIZE;
+            int count = std::min(HEIGHT_BLOCK_SIZE, w - x0);
+            selected.dequantizeHeights(row + x0, count, heights.scale(), heights.offset(), out);
+            std::fill(out + count, out + HEIGHT_BLOCK_SIZE, out[count - 1]);
+        }
+    }
+}
+
+void BlockedHeightField::toRowMajor(int z, float* row) const
+{
+    for (int x0 = 0; x0 < w; x0 += HEIGHT_BLOCK_SIZE) {
+        const float* in = &samples[index(x0, z)];
+        std::copy(in, in + std::min(HEIGHT_BLOCK_SIZE, w - x0), row + x0);
+    }
+}
+
+void QuantizedHeightField::reset(int width, int height, float lowest, float highest)
+{
+    w = width;
+    h = height;
+    base = lowest;
+    step = highest > lowest ? (highest - lowest) / 65535.0f : 0.0f; // An empty range quantizes to all zeros
+    samples.assign(static_cast<size_t>(width) * height, 0);
+}
+
+void QuantizedHeightField::quantizeRow(int z, const float* heights)
+{
+    unsigned short* row = &samples[static_cast<size_t>(z) * w];
+    float inverse = step > 0.0f ? 1.0f / step : 0.0f;
+    for (int x = 0; x < w; x++) {
+        long value = std::lround((heights[x] - base) * inverse);
+        row[x] = static_cast<unsigned short>(std::min(std::max(value, 0L), 65535L));
+    }
+}
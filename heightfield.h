@@ -0,0 +1,125 @@
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <vector>
+
+// Samples per side of a block, a power of two so indexing is shifts and masks. A 32x32 float
+// block is 4 KB, so a stencil reads its neighbours from the block it is already walking.
+const int HEIGHT_BLOCK_SHIFT = 5;
+const int HEIGHT_BLOCK_SIZE = 1 << HEIGHT_BLOCK_SHIFT;
+
+// A sample and its four grid neighbours, clamped to the edge of the grid
+struct HeightNeighbourhood {
+    float center;
+    float left;  // x - 1
+    float right; // x + 1
+    float down;  // z - 1
+    float up;    // z + 1
+};
+
+class QuantizedHeightField;
+
+// Heightfield stored as HEIGHT_BLOCK_SIZE x HEIGHT_BLOCK_SIZE blocks, row-major inside each block and
+// blocks in row-major order. Row-major grids put the rows above and below a sample width floats apart,
+// which on 8k+ grids means three distant streams per stencil; here they are one block row away.
+// Built for the normal stencils on upload, see writeTerrainVertices and generateNormalMap.
+class BlockedHeightField {
+public:
+    BlockedHeightField() {}
+    explicit BlockedHeightField(const QuantizedHeightField& heights) { assign(heights); }
+
+    // Dequantizes the cached 16-bit field straight into blocks with the kernel selected for this CPU
+    void assign(const QuantizedHeightField& heights);
+    // Copies grid row z back to row-major order, width() floats
+    void toRowMajor(int z, float* row) const;
+
+    int width() const { return w; }
+    int height() const { return h; }
+    bool empty() const { return samples.empty(); }
+
+    size_t index(int x, int z) const
+    {
+        const int mask = HEIGHT_BLOCK_SIZE - 1;
+        size_t block = static_cast<size_t>(z >> HEIGHT_BLOCK_SHIFT) * blocksX + (x >> HEIGHT_BLOCK_SHIFT);
+        return (block << (2 * HEIGHT_BLOCK_SHIFT)) + ((z & mask) << HEIGHT_BLOCK_SHIFT) + (x & mask);
+    }
+    float at(int x, int z) const { return samples[index(x, z)]; }
+    // Positions outside the grid repeat the nearest edge sample
+    float clampedAt(int x, int z) const { return at(std::min(std::max(x, 0), w - 1), std::min(std::max(z, 0), h - 1)); }
+    // First sample of row z inside block column bx, HEIGHT_BLOCK_SIZE floats with the rows above and
+    // below it HEIGHT_BLOCK_SIZE floats away
+    const float* blockRow(int bx, int z) const { return &samples[index(bx << HEIGHT_BLOCK_SHIFT, z)]; }
+
+    // Calls visit(x, z, neighbourhood) for every sample in storage order, block by block.
+    // Neighbours inside the block are plain offsets, only the block's outer ring takes the clamped path.
+    template <typename Visit>
+    void forEachNeighbourhood(Visit visit) const
+    {
+        const int size = HEIGHT_BLOCK_SIZE;
+        for (int bz = 0; bz < blocksZ; bz++) {
+            for (int bx = 0; bx < blocksX; bx++) {
+                const float* block = &samples[static_cast<size_t>(bz * blocksX + bx) * size * size];
+                int x0 = bx * size;
+                int z0 = bz * size;
+                int xEnd = std::min(size, w - x0);
+                int zEnd = std::min(size, h - z0);
+                for (int z = 0; z < zEnd; z++) {
+                    bool innerRow = z > 0 && z < size - 1;
+                    for (int x = 0; x < xEnd; x++) {
+                        const float* p = block + z * size + x;
+                        HeightNeighbourhood n;
+                        n.center = *p;
+                        if (innerRow && x > 0 && x < size - 1) {
+                            n.left = p[-1];
+                            n.right = p[1];
+                            n.down = p[-size];
+                            n.up = p[size];
+                        } else {
+                            n.left = clampedAt(x0 + x - 1, z0 + z);
+                            n.right = clampedAt(x0 + x + 1, z0 + z);
+                            n.down = clampedAt(x0 + x, z0 + z - 1);
+                            n.up = clampedAt(x0 + x, z0 + z + 1);
+                        }
+                        visit(x0 + x, z0 + z, n);
+                    }
+                }
+            }
+        }
+    }
+
+private:
+    int w = 0;
+    int h = 0;
+    int blocksX = 0;
+    int blocksZ = 0;
+    std::vector<float> samples; // Whole blocks, the padding past the grid repeats the edge samples
+};
+
+// Heightfield quantized to 16 bits over the fixed height range of its source, half the memory of floats.
+// It is the cached heightfield of every non-chunked path: rows are quantized as they are generated, and the
+// stencils and uploads dequantize them again. A step of 1/65535 of the range keeps 8-bit image levels exact.
+class QuantizedHeightField {
+public:
+    // Sizes the field for heights in [lowest, highest], every sample starts at lowest
+    void reset(int width, int height, float lowest, float highest);
+    void clear() { reset(0, 0, 0.0f, 0.0f); }
+    // Quantizes width() heights into row z, heights outside the range are clamped to it
+    void quantizeRow(int z, const float* heights);
+
+    int width() const { return w; }
+    int height() const { return h; }
+    bool empty() const { return samples.empty(); }
+    const unsigned short* data() const { return samples.data(); }
+
+    // Height of a sample is offset() + scale() * sample, or offset() + range() * the normalized R16 texel
+    float scale() const { return step; }
+    float offset() const { return base; }
+    float range() const { return step * 65535.0f; }
+
+private:
+    int w = 0;
+    int h = 0;
+    float step = 0.0f;
+    float base = 0.0f;
+    std::vector<unsigned short> samples; // Row-major
+};
@@ -0,0 +1,71 @@
+#include "kernels.h"
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+// Names accepted by TERRAIN_ISA, indexed by CpuIsa
+static const char* const ISA_NAMES[] = {"scalar", "sse2", "sse4.1", "avx2"};
+const int ISA_COUNT = 4;
+
+const char* cpuIsaName(CpuIsa isa)
+{
+    return ISA_NAMES[static_cast<int>(isa)];
+}
+
+static bool cpuSupports(CpuIsa isa)
+{
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+    // Also checks that the OS saves the AVX registers
+    __builtin_cpu_init();
+    switch (isa) {
+    case CpuIsa::SCALAR: return true;
+    case CpuIsa::SSE2: return __builtin_cpu_supports("sse2");
+    case CpuIsa::SSE41: return __builtin_cpu_supports("sse4.1");
+    case CpuIsa::AVX2: return __builtin_cpu_supports("avx2");
+    }
+    return false;
+#else
+    return isa == CpuIsa::SCALAR;
+#endif
+}
+
+const Kernels* kernelsFor(CpuIsa isa)
+{
+    const Kernels* table = nullptr;
+    switch (isa) {
+    case CpuIsa::SCALAR: table = scalarKernels(); break;
+    case CpuIsa::SSE2: table = sse2Kernels(); break;
+    case CpuIsa::SSE41: table = sse41Kernels(); break;
+    case CpuIsa::AVX2: table = avx2Kernels(); break;
+    }
+    return table && cpuSupports(isa) ? table : nullptr;
+}
+
+static const Kernels& selectKernels()
+{
+    // TERRAIN_ISA caps the search, which then falls back to the widest variant at or below it
+    int highest = ISA_COUNT - 1;
+    const char* requested = std::getenv("TERRAIN_ISA");
+    if (requested && *requested) {
+        int match = 0;
+        while (match < ISA_COUNT && std::strcmp(requested, ISA_NAMES[match]) != 0) match++;
+        if (match == ISA_COUNT) {
+            std::cerr << "Unknown TERRAIN_ISA '" << requested << "', expected scalar, sse2, sse4.1 or avx2" << std::endl;
+        } else {
+            highest = match;
+            if (!kernelsFor(static_cast<CpuIsa>(match)))
+                std::cerr << "TERRAIN_ISA=" << requested << " is not supported by this CPU or build, using a narrower one" << std::endl;
+        }
+    }
+    for (int isa = highest; isa > 0; isa--) {
+        if (const Kernels* table = kernelsFor(static_cast<CpuIsa>(isa))) return *table;
+    }
+    return *scalarKernels();
+}
+
+const Kernels& kernels()
+{
+    // Thread-safe initialization, generation may first run on a worker thread
+    static const Kernels& selected = selectKernels();
+    return selected;
+}
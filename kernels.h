@@ -0,0 +1,60 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+// Instruction sets with their own kernel builds, in increasing order
+enum class CpuIsa {
+    SCALAR,
+    SSE2,
+    SSE41,
+    AVX2
+};
+
+// Hot loops compiled once per instruction set. Every variant gives bit-identical results, so the
+// instruction set picked at runtime never changes the generated terrain.
+struct Kernels {
+    CpuIsa isa;
+    // heights[i] = samples[i] * scale + offset
+    void (*dequantizeHeights)(const unsigned short* samples, std::size_t count, float scale, float offset, float* heights);
+    // Simplex noise of count points, see SimplexNoise
+    void (*simplexNoise)(std::uint32_t seed, const float* x, const float* y, float* values, std::size_t count);
+    // RG8 normals of samples 1 to width - 2 of a heightfield row, reading row[-width] and row[width].
+    // texels points at the row's first texel, the two border texels are left to the caller.
+    void (*encodeNormalRow)(const float* row, int width, float heightScale, unsigned char* texels);
+    // Fixed-point noise of count points, see FixedNoise. Integer only, so exact on every variant and platform.
+    void (*fixedNoise)(std::uint32_t seed, const std::uint32_t* x, const std::uint32_t* y, std::int32_t* values, std::size_t count);
+};
+
+// Kernels for the best instruction set of this CPU, chosen on first use. The TERRAIN_ISA environment
+// variable (scalar, sse2, sse4.1 or avx2) selects a lower one, e.g. for benchmarking.
+const Kernels& kernels();
+// Variant for one instruction set, nullptr when it was not built or the CPU lacks it
+const Kernels* kernelsFor(CpuIsa isa);
+const char* cpuIsaName(CpuIsa isa);
+
+// Per-variant tables, defined by the kernel translation units; nullptr when not built for this target
+const Kernels* scalarKernels();
+const Kernels* sse2Kernels();
+const Kernels* sse41Kernels();
+const Kernels* avx2Kernels();
+// One simplex sample from the scalar build, what SimplexNoise::noise(x, y) evaluates
+float simplexNoise(std::uint32_t seed, float x, float y);
+// One fixed-point noise sample from the scalar build, what FixedNoise::sample(x, y) evaluates
+std::int32_t fixedNoise(std::uint32_t seed, std::uint32_t x, std::uint32_t y);
+
+// Fraction bits of fixed-point noise coordinates and values: 16.16 coordinates, FIXED_NOISE_ONE is 1.0
+const int FIXED_NOISE_BITS = 16;
+const std::int32_t FIXED_NOISE_ONE = 1 << FIXED_NOISE_BITS;
+
+// Gradient hash of a noise lattice corner: combines the corner with the seed, then mixes with the
+// lowbias32 finalizer. Shared by HashNoise and the simplex kernels.
+inline std::uint32_t hashCorner(std::uint32_t seed, std::uint32_t x, std::uint32_t y)
+{
+    std::uint32_t h = seed ^ (x * 0x8da6b343u) ^ (y * 0xd8163841u);
+    h ^= h >> 16;
+    h *= 0x7feb352du;
+    h ^= h >> 15;
+    h *= 0x846ca68bu;
+    h ^= h >> 16;
+    return h;
+}
@@ -0,0 +1,18 @@
+// AVX2 kernels, built with -mavx2 on x86 (see makefile) and left empty on other targets
+#if defined(__AVX2__)
+#define KERNEL_NAMESPACE avx2
+#define KERNEL_LEVEL 3
+#include "kernels_impl.h"
+
+const Kernels* avx2Kernels()
+{
+    return &avx2::table;
+}
+#else
+#include "kernels.h"
+
+const Kernels* avx2Kernels()
+{
+    return nullptr;
+}
+#endif
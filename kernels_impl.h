@@ -0,0 +1,524 @@
+#pragma once
+// Kernel bodies shared by every instruction-set build. A kernel translation unit defines KERNEL_NAMESPACE
+// and KERNEL_LEVEL (0 scalar, 1 SSE2, 2 SSE4.1, 3 AVX2, the CpuIsa order) and is compiled with the matching
+// flags. Only the kernels_*.cpp files include this header.
+//
+// Everything here lives in KERNEL_NAMESPACE and calls no inline functions or templates from other
+// headers: the linker keeps one copy of those, which could be the one built for a wider instruction set.
+// The vector paths perform the scalar operations in the same order, so all levels agree bit for bit.
+#include "kernels.h"
+#include <math.h>
+#if KERNEL_LEVEL >= 3
+#include <immintrin.h>
+#elif KERNEL_LEVEL >= 2
+#include <smmintrin.h>
+#elif KERNEL_LEVEL >= 1
+#include <emmintrin.h>
+#endif
+
+#if (KERNEL_LEVEL >= 1 && !defined(__SSE2__)) || (KERNEL_LEVEL >= 2 && !defined(__SSE4_1__)) || (KERNEL_LEVEL >= 3 && !defined(__AVX2__))
+#error "kernel translation unit compiled without the flags for its KERNEL_LEVEL"
+#endif
+
+namespace KERNEL_NAMESPACE {
+
+// Simplex lattice constants: (sqrt(3) - 1) / 2 skews a point onto the square grid, (3 - sqrt(3)) / 6 undoes it
+const float SIMPLEX_SKEW = 0.366025403784f;
+const float SIMPLEX_UNSKEW = 0.211324865405f;
+// Brings the sum of the three corner contributions to about [-1, 1], measured peak 0.0143 before scaling
+const float SIMPLEX_SCALE = 70.0f;
+
+// Fraction bits of the fade and interpolation weights in fixedNoise, coordinates keep FIXED_NOISE_BITS
+const int FIXED_FADE_BITS = 12;
+const std::int32_t FIXED_FADE_ONE = 1 << FIXED_FADE_BITS;
+
+// Per-level copy of the inline hashCorner from kernels.h, which it hides inside this namespace
+static inline std::uint32_t hashCorner(std::uint32_t seed, std::uint32_t x, std::uint32_t y)
+{
+    std::uint32_t h = seed ^ (x * 0x8da6b343u) ^ (y * 0xd8163841u);
+    h ^= h >> 16;
+    h *= 0x7feb352du;
+    h ^= h >> 15;
+    h *= 0x846ca68bu;
+    h ^= h >> 16;
+    return h;
+}
+
+// Falloff-weighted gradient of one simplex corner, the same 8 gradients as HashNoise
+static inline float simplexCorner(std::uint32_t hash, float x, float y)
+{
+    std::uint32_t h = hash & 7;
+    float u = h < 6 ? x : y;
+    float v = h < 4 ? y : 0.0f;
+    float g = ((h & 1) == 0 ? u : -u) + ((h & 2) == 0 ? v : -v);
+
+    float t = 0.5f - x * x - y * y;
+    t = t > 0.0f ? t : 0.0f;
+    t *= t;
+    return t * t * g;
+}
+
+static inline float simplexSample(std::uint32_t seed, float x, float y)
+{
+    // Skews into the square lattice to find the cell, then back to get the offset from its first corner
+    float s = (x + y) * SIMPLEX_SKEW;
+    float i = floorf(x + s);
+    float j = floorf(y + s);
+    float t = (i + j) * SIMPLEX_UNSKEW;
+    float x0 = x - (i - t);
+    float y0 = y - (j - t);
+
+    // The cell splits into two triangles, the middle corner depends on which one the point is in
+    float i1 = x0 > y0 ? 1.0f : 0.0f;
+    float j1 = 1.0f - i1;
+    float x1 = x0 - i1 + SIMPLEX_UNSKEW;
+    float y1 = y0 - j1 + SIMPLEX_UNSKEW;
+    float x2 = x0 - 1.0f + 2.0f * SIMPLEX_UNSKEW;
+    float y2 = y0 - 1.0f + 2.0f * SIMPLEX_UNSKEW;
+
+    std::uint32_t I = static_cast<std::uint32_t>(static_cast<std::int32_t>(i));
+    std::uint32_t J = static_cast<std::uint32_t>(static_cast<std::int32_t>(j));
+    std::uint32_t I1 = static_cast<std::uint32_t>(i1);
+    float n = simplexCorner(hashCorner(seed, I, J), x0, y0)
+            + simplexCorner(hashCorner(seed, I + I1, J + (1 - I1)), x1, y1);
+    n = n + simplexCorner(hashCorner(seed, I + 1, J + 1), x2, y2);
+    return SIMPLEX_SCALE * n;
+}
+
+// lround for the non-negative values encodeNormal produces, spelled out so the vector paths can match it
+static inline unsigned char encodeComponent(float normal)
+{
+    float scaled = (normal * 0.5f + 0.5f) * 255.0f;
+    int truncated = static_cast<int>(scaled);
+    return static_cast<unsigned char>(truncated + (scaled - static_cast<float>(truncated) >= 0.5f ? 1 : 0));
+}
+
+// calculateNormal followed by encodeNormal, normalized with the same operations as glm::normalize
+static inline void encodeNormalTexel(float hL, float hR, float hD, float hU, unsigned char* texel)
+{
+    float nx = hL - hR;
+    float nz = hD - hU;
+    float inverse = 1.0f / sqrtf((nx * nx + 4.0f) + nz * nz);
+    texel[0] = encodeComponent(nx * inverse);
+    texel[1] = encodeComponent(nz * inverse);
+}
+
+// Floor of value / 2^shift, the arithmetic shift the vector paths use. Spelled out because >> of a
+// negative value is implementation-defined in C++11.
+static inline std::int32_t shiftDown(std::int32_t value, int shift)
+{
+    return value >= 0 ? value >> shift : ~(~value >> shift);
+}
+
+// HashNoise::grad on 16.16 fixed-point offsets
+static inline std::int32_t fixedGrad(std::uint32_t hash, std::int32_t x, std::int32_t y)
+{
+    std::uint32_t h = hash & 7;
+    std::int32_t u = h < 6 ? x : y;
+    std::int32_t v = h < 4 ? y : 0;
+    return ((h & 1) == 0 ? u : -u) + ((h & 2) == 0 ? v : -v);
+}
+
+// Quintic fade 6t^5 - 15t^4 + 10t^3 in Q12, as t^3 (t (6t - 15) + 10). Every product fits 32 bits.
+static inline std::int32_t fixedFade(std::int32_t t)
+{
+    std::int32_t t2 = (t * t) >> FIXED_FADE_BITS;
+    std::int32_t t3 = (t2 * t) >> FIXED_FADE_BITS;
+    std::int32_t inner = shiftDown(t * (6 * t - 15 * FIXED_FADE_ONE), FIXED_FADE_BITS) + 10 * FIXED_FADE_ONE;
+    return (t3 * inner) >> FIXED_FADE_BITS;
+}
+
+static inline std::int32_t fixedLerp(std::int32_t t, std::int32_t a, std::int32_t b)
+{
+    return a + shiftDown((b - a) * t, FIXED_FADE_BITS);
+}
+
+static inline std::int32_t fixedSample(std::uint32_t seed, std::uint32_t x, std::uint32_t y)
+{
+    // Integer part picks the lattice cell, the 16 fraction bits are the position inside it
+    std::uint32_t X = x >> FIXED_NOISE_BITS;
+    std::uint32_t Y = y >> FIXED_NOISE_BITS;
+    std::int32_t fx = static_cast<std::int32_t>(x & (FIXED_NOISE_ONE - 1));
+    std::int32_t fy = static_cast<std::int32_t>(y & (FIXED_NOISE_ONE - 1));
+    std::int32_t u = fixedFade(fx >> (FIXED_NOISE_BITS - FIXED_FADE_BITS));
+    std::int32_t v = fixedFade(fy >> (FIXED_NOISE_BITS - FIXED_FADE_BITS));
+    std::int32_t gx = fx - FIXED_NOISE_ONE;
+    std::int32_t gy = fy - FIXED_NOISE_ONE;
+    return fixedLerp(v, fixedLerp(u, fixedGrad(hashCorner(seed, X, Y), fx, fy), fixedGrad(hashCorner(seed, X + 1, Y), gx, fy)),
+                        fixedLerp(u, fixedGrad(hashCorner(seed, X, Y + 1), fx, gy), fixedGrad(hashCorner(seed, X + 1, Y + 1), gx, gy)));
+}
+
+#if KERNEL_LEVEL >= 1
+// 32-bit multiply keeping the low halves, SSE2 only multiplies even lanes so odd lanes are shifted down
+static inline __m128i mulLow(__m128i a, __m128i b)
+{
+#if KERNEL_LEVEL >= 2
+    return _mm_mullo_epi32(a, b);
+#else
+    __m128i even = _mm_mul_epu32(a, b);
+    __m128i odd = _mm_mul_epu32(_mm_srli_epi64(a, 32), _mm_srli_epi64(b, 32));
+    return _mm_unpacklo_epi32(_mm_shuffle_epi32(even, _MM_SHUFFLE(0, 0, 2, 0)), _mm_shuffle_epi32(odd, _MM_SHUFFLE(0, 0, 2, 0)));
+#endif
+}
+
+static inline __m128 floorVector(__m128 v)
+{
+#if KERNEL_LEVEL >= 2
+    return _mm_floor_ps(v);
+#else
+    // Truncation rounds negative values up, those lanes are moved down by one
+    __m128 truncated = _mm_cvtepi32_ps(_mm_cvttps_epi32(v));
+    return _mm_sub_ps(truncated, _mm_and_ps(_mm_cmpgt_ps(truncated, v), _mm_set1_ps(1.0f)));
+#endif
+}
+
+static inline __m128i hashCorners(__m128i seed, __m128i x, __m128i y)
+{
+    __m128i h = _mm_xor_si128(seed, _mm_xor_si128(mulLow(x, _mm_set1_epi32(static_cast<int>(0x8da6b343u))),
+                                                  mulLow(y, _mm_set1_epi32(static_cast<int>(0xd8163841u)))));
+    h = _mm_xor_si128(h, _mm_srli_epi32(h, 16));
+    h = mulLow(h, _mm_set1_epi32(0x7feb352d));
+    h = _mm_xor_si128(h, _mm_srli_epi32(h, 15));
+    h = mulLow(h, _mm_set1_epi32(static_cast<int>(0x846ca68bu)));
+    return _mm_xor_si128(h, _mm_srli_epi32(h, 16));
+}
+
+static inline __m128 simplexCorners(__m128i hash, __m128 x, __m128 y)
+{
+    // Gradient selection as in simplexCorner, with masks instead of branches
+    __m128i h = _mm_and_si128(hash, _mm_set1_epi32(7));
+    __m128 useX = _mm_castsi128_ps(_mm_cmplt_epi32(h, _mm_set1_epi32(6)));
+    __m128 useY = _mm_castsi128_ps(_mm_cmplt_epi32(h, _mm_set1_epi32(4)));
+    __m128 u = _mm_or_ps(_mm_and_ps(useX, x), _mm_andnot_ps(useX, y));
+    __m128 v = _mm_and_ps(useY, y);
+    u = _mm_xor_ps(u, _mm_castsi128_ps(_mm_slli_epi32(_mm_and_si128(h, _mm_set1_epi32(1)), 31)));
+    v = _mm_xor_ps(v, _mm_castsi128_ps(_mm_slli_epi32(_mm_and_si128(h, _mm_set1_epi32(2)), 30)));
+    __m128 g = _mm_add_ps(u, v);
+
+    __m128 t = _mm_sub_ps(_mm_sub_ps(_mm_set1_ps(0.5f), _mm_mul_ps(x, x)), _mm_mul_ps(y, y));
+    t = _mm_max_ps(t, _mm_setzero_ps());
+    t = _mm_mul_ps(t, t);
+    return _mm_mul_ps(_mm_mul_ps(t, t), g);
+}
+
+// fixedGrad, fixedFade and fixedLerp on four lanes: the same 32-bit products and shifts
+static inline __m128i fixedGrads(__m128i hash, __m128i x, __m128i y)
+{
+    __m128i h = _mm_and_si128(hash, _mm_set1_epi32(7));
+    __m128i useX = _mm_cmplt_epi32(h, _mm_set1_epi32(6));
+    __m128i useY = _mm_cmplt_epi32(h, _mm_set1_epi32(4));
+    __m128i u = _mm_or_si128(_mm_and_si128(useX, x), _mm_andnot_si128(useX, y));
+    __m128i v = _mm_and_si128(useY, y);
+    // Negates where the sign bit is set: (u ^ -1) - -1 is -u
+    __m128i signU = _mm_sub_epi32(_mm_setzero_si128(), _mm_and_si128(h, _mm_set1_epi32(1)));
+    __m128i signV = _mm_sub_epi32(_mm_setzero_si128(), _mm_srli_epi32(_mm_and_si128(h, _mm_set1_epi32(2)), 1));
+    return _mm_add_epi32(_mm_sub_epi32(_mm_xor_si128(u, signU), signU), _mm_sub_epi32(_mm_xor_si128(v, signV), signV));
+}
+
+static inline __m128i fixedFades(__m128i t)
+{
+    __m128i t2 = _mm_srli_epi32(mulLow(t, t), FIXED_FADE_BITS);
+    __m128i t3 = _mm_srli_epi32(mulLow(t2, t), FIXED_FADE_BITS);
+    __m128i inner = _mm_sub_epi32(mulLow(t, _mm_set1_epi32(6)), _mm_set1_epi32(15 * FIXED_FADE_ONE));
+    inner = _mm_add_epi32(_mm_srai_epi32(mulLow(t, inner), FIXED_FADE_BITS), _mm_set1_epi32(10 * FIXED_FADE_ONE));
+    return _mm_srli_epi32(mulLow(t3, inner), FIXED_FADE_BITS);
+}
+
+static inline __m128i fixedLerps(__m128i t, __m128i a, __m128i b)
+{
+    return _mm_add_epi32(a, _mm_srai_epi32(mulLow(_mm_sub_epi32(b, a), t), FIXED_FADE_BITS));
+}
+
+// encodeComponent on four lanes
+static inline __m128i encodeComponents(__m128 normal)
+{
+    const __m128 half = _mm_set1_ps(0.5f);
+    __m128 scaled = _mm_mul_ps(_mm_add_ps(_mm_mul_ps(normal, half), half), _mm_set1_ps(255.0f));
+    __m128i truncated = _mm_cvttps_epi32(scaled);
+    __m128 fraction = _mm_sub_ps(scaled, _mm_cvtepi32_ps(truncated));
+    // The comparison mask is -1 where the value rounds up
+    return _mm_sub_epi32(truncated, _mm_castps_si128(_mm_cmpge_ps(fraction, half)));
+}
+
+// Interleaves four x and z components in [0, 255] into four RG8 texels
+static inline void storeTexels(__m128i x, __m128i z, unsigned char* texels)
+{
+    __m128i bytes = _mm_packus_epi16(_mm_packs_epi32(x, z), _mm_setzero_si128()); // x0..x3 z0..z3
+    _mm_storel_epi64(reinterpret_cast<__m128i*>(texels), _mm_unpacklo_epi8(bytes, _mm_srli_si128(bytes, 4)));
+}
+#endif
+
+#if KERNEL_LEVEL >= 3
+static inline __m256i hashCorners8(__m256i seed, __m256i x, __m256i y)
+{
+    __m256i h = _mm256_xor_si256(seed, _mm256_xor_si256(_mm256_mullo_epi32(x, _mm256_set1_epi32(static_cast<int>(0x8da6b343u))),
+                                                        _mm256_mullo_epi32(y, _mm256_set1_epi32(static_cast<int>(0xd8163841u)))));
+    h = _mm256_xor_si256(h, _mm256_srli_epi32(h, 16));
+    h = _mm256_mullo_epi32(h, _mm256_set1_epi32(0x7feb352d));
+    h = _mm256_xor_si256(h, _mm256_srli_epi32(h, 15));
+    h = _mm256_mullo_epi32(h, _mm256_set1_epi32(static_cast<int>(0x846ca68bu)));
+    return _mm256_xor_si256(h, _mm256_srli_epi32(h, 16));
+}
+
+static inline __m256 simplexCorners8(__m256i hash, __m256 x, __m256 y)
+{
+    __m256i h = _mm256_and_si256(hash, _mm256_set1_epi32(7));
+    __m256 useX = _mm256_castsi256_ps(_mm256_cmpgt_epi32(_mm256_set1_epi32(6), h));
+    __m256 useY = _mm256_castsi256_ps(_mm256_cmpgt_epi32(_mm256_set1_epi32(4), h));
+    __m256 u = _mm256_blendv_ps(y, x, useX);
+    __m256 v = _mm256_and_ps(useY, y);
+    u = _mm256_xor_ps(u, _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_and_si256(h, _mm256_set1_epi32(1)), 31)));
+    v = _mm256_xor_ps(v, _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_and_si256(h, _mm256_set1_epi32(2)), 30)));
+    __m256 g = _mm256_add_ps(u, v);
+
+    __m256 t = _mm256_sub_ps(_mm256_sub_ps(_mm256_set1_ps(0.5f), _mm256_mul_ps(x, x)), _mm256_mul_ps(y, y));
+    t = _mm256_max_ps(t, _mm256_setzero_ps());
+    t = _mm256_mul_ps(t, t);
+    return _mm256_mul_ps(_mm256_mul_ps(t, t), g);
+}
+
+static inline __m256i fixedGrads8(__m256i hash, __m256i x, __m256i y)
+{
+    __m256i h = _mm256_and_si256(hash, _mm256_set1_epi32(7));
+    __m256i useX = _mm256_cmpgt_epi32(_mm256_set1_epi32(6), h);
+    __m256i useY = _mm256_cmpgt_epi32(_mm256_set1_epi32(4), h);
+    __m256i u = _mm256_blendv_epi8(y, x, useX);
+    __m256i v = _mm256_and_si256(useY, y);
+    __m256i signU = _mm256_sub_epi32(_mm256_setzero_si256(), _mm256_and_si256(h, _mm256_set1_epi32(1)));
+    __m256i signV = _mm256_sub_epi32(_mm256_setzero_si256(), _mm256_srli_epi32(_mm256_and_si256(h, _mm256_set1_epi32(2)), 1));
+    return _mm256_add_epi32(_mm256_sub_epi32(_mm256_xor_si256(u, signU), signU), _mm256_sub_epi32(_mm256_xor_si256(v, signV), signV));
+}
+
+static inline __m256i fixedFades8(__m256i t)
+{
+    __m256i t2 = _mm256_srli_epi32(_mm256_mullo_epi32(t, t), FIXED_FADE_BITS);
+    __m256i t3 = _mm256_srli_epi32(_mm256_mullo_epi32(t2, t), FIXED_FADE_BITS);
+    __m256i inner = _mm256_sub_epi32(_mm256_mullo_epi32(t, _mm256_set1_epi32(6)), _mm256_set1_epi32(15 * FIXED_FADE_ONE));
+    inner = _mm256_add_epi32(_mm256_srai_epi32(_mm256_mullo_epi32(t, inner), FIXED_FADE_BITS), _mm256_set1_epi32(10 * FIXED_FADE_ONE));
+    return _mm256_srli_epi32(_mm256_mullo_epi32(t3, inner), FIXED_FADE_BITS);
+}
+
+static inline __m256i fixedLerps8(__m256i t, __m256i a, __m256i b)
+{
+    return _mm256_add_epi32(a, _mm256_srai_epi32(_mm256_mullo_epi32(_mm256_sub_epi32(b, a), t), FIXED_FADE_BITS));
+}
+
+static inline __m256i encodeComponents8(__m256 normal)
+{
+    const __m256 half = _mm256_set1_ps(0.5f);
+    __m256 scaled = _mm256_mul_ps(_mm256_add_ps(_mm256_mul_ps(normal, half), half), _mm256_set1_ps(255.0f));
+    __m256i truncated = _mm256_cvttps_epi32(scaled);
+    __m256 fraction = _mm256_sub_ps(scaled, _mm256_cvtepi32_ps(truncated));
+    return _mm256_sub_epi32(truncated, _mm256_castps_si256(_mm256_cmp_ps(fraction, half, _CMP_GE_OQ)));
+}
+#endif
+
+static void dequantizeHeights(const unsigned short* samples, std::size_t count, float scale, float offset, float* heights)
+{
+    std::size_t i = 0;
+#if KERNEL_LEVEL >= 3
+    // Eight samples per iteration, widened straight to 32-bit integers
+    const __m256 scales8 = _mm256_set1_ps(scale);
+    const __m256 offsets8 = _mm256_set1_ps(offset);
+    for (; i + 8 <= count; i += 8) {
+        __m256i wide = _mm256_cvtepu16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(samples + i)));
+        _mm256_storeu_ps(heights + i, _mm256_add_ps(_mm256_mul_ps(_mm256_cvtepi32_ps(wide), scales8), offsets8));
+    }
+#elif KERNEL_LEVEL >= 1
+    // Eight samples per iteration, widened to two vectors of 32-bit integers
+    const __m128 scales = _mm_set1_ps(scale);
+    const __m128 offsets = _mm_set1_ps(offset);
+    for (; i + 8 <= count; i += 8) {
+        __m128i packed = _mm_loadu_si128(reinterpret_cast<const __m128i*>(samples + i));
+#if KERNEL_LEVEL >= 2
+        __m128i low = _mm_cvtepu16_epi32(packed);
+        __m128i high = _mm_cvtepu16_epi32(_mm_srli_si128(packed, 8));
+#else
+        __m128i low = _mm_unpacklo_epi16(packed, _mm_setzero_si128());
+        __m128i high = _mm_unpackhi_epi16(packed, _mm_setzero_si128());
+#endif
+        _mm_storeu_ps(heights + i, _mm_add_ps(_mm_mul_ps(_mm_cvtepi32_ps(low), scales), offsets));
+        _mm_storeu_ps(heights + i + 4, _mm_add_ps(_mm_mul_ps(_mm_cvtepi32_ps(high), scales), offsets));
+    }
+#endif
+    // Remaining samples, or all of them in the scalar build; same multiply then add as the vector paths
+    for (; i < count; i++)
+        heights[i] = static_cast<float>(samples[i]) * scale + offset;
+}
+
+static void simplexNoise(std::uint32_t seed, const float* x, const float* y, float* values, std::size_t count)
+{
+    std::size_t k = 0;
+#if KERNEL_LEVEL >= 3
+    // Same operations as simplexSample() in the same order, eight samples per iteration
+    {
+        const __m256 one = _mm256_set1_ps(1.0f);
+        const __m256 unskew = _mm256_set1_ps(SIMPLEX_UNSKEW);
+        const __m256 unskew2 = _mm256_set1_ps(2.0f * SIMPLEX_UNSKEW);
+        const __m256i seeds = _mm256_set1_epi32(static_cast<int>(seed));
+        const __m256i ones = _mm256_set1_epi32(1);
+        for (; k + 8 <= count; k += 8) {
+            __m256 vx = _mm256_loadu_ps(x + k);
+            __m256 vy = _mm256_loadu_ps(y + k);
+            __m256 s = _mm256_mul_ps(_mm256_add_ps(vx, vy), _mm256_set1_ps(SIMPLEX_SKEW));
+            __m256 i = _mm256_floor_ps(_mm256_add_ps(vx, s));
+            __m256 j = _mm256_floor_ps(_mm256_add_ps(vy, s));
+            __m256 t = _mm256_mul_ps(_mm256_add_ps(i, j), unskew);
+            __m256 x0 = _mm256_sub_ps(vx, _mm256_sub_ps(i, t));
+            __m256 y0 = _mm256_sub_ps(vy, _mm256_sub_ps(j, t));
+
+            __m256 lower = _mm256_cmp_ps(x0, y0, _CMP_GT_OQ);
+            __m256 i1 = _mm256_and_ps(lower, one);
+            __m256 j1 = _mm256_sub_ps(one, i1);
+            __m256 x1 = _mm256_add_ps(_mm256_sub_ps(x0, i1), unskew);
+            __m256 y1 = _mm256_add_ps(_mm256_sub_ps(y0, j1), unskew);
+            __m256 x2 = _mm256_add_ps(_mm256_sub_ps(x0, one), unskew2);
+            __m256 y2 = _mm256_add_ps(_mm256_sub_ps(y0, one), unskew2);
+
+            __m256i I = _mm256_cvttps_epi32(i);
+            __m256i J = _mm256_cvttps_epi32(j);
+            __m256i I1 = _mm256_and_si256(_mm256_castps_si256(lower), ones);
+            __m256 n = _mm256_add_ps(simplexCorners8(hashCorners8(seeds, I, J), x0, y0),
+                                     simplexCorners8(hashCorners8(seeds, _mm256_add_epi32(I, I1), _mm256_add_epi32(J, _mm256_sub_epi32(ones, I1))), x1, y1));
+            n = _mm256_add_ps(n, simplexCorners8(hashCorners8(seeds, _mm256_add_epi32(I, ones), _mm256_add_epi32(J, ones)), x2, y2));
+            _mm256_storeu_ps(values + k, _mm256_mul_ps(_mm256_set1_ps(SIMPLEX_SCALE), n));
+        }
+    }
+#endif
+#if KERNEL_LEVEL >= 1
+    // Four samples per iteration, the whole batch below AVX2 or the remainder above it
+    const __m128 one = _mm_set1_ps(1.0f);
+    const __m128 unskew = _mm_set1_ps(SIMPLEX_UNSKEW);
+    const __m128 unskew2 = _mm_set1_ps(2.0f * SIMPLEX_UNSKEW);
+    const __m128i seeds = _mm_set1_epi32(static_cast<int>(seed));
+    const __m128i ones = _mm_set1_epi32(1);
+    for (; k + 4 <= count; k += 4) {
+        __m128 vx = _mm_loadu_ps(x + k);
+        __m128 vy = _mm_loadu_ps(y + k);
+        __m128 s = _mm_mul_ps(_mm_add_ps(vx, vy), _mm_set1_ps(SIMPLEX_SKEW));
+        __m128 i = floorVector(_mm_add_ps(vx, s));
+        __m128 j = floorVector(_mm_add_ps(vy, s));
+        __m128 t = _mm_mul_ps(_mm_add_ps(i, j), unskew);
+        __m128 x0 = _mm_sub_ps(vx, _mm_sub_ps(i, t));
+        __m128 y0 = _mm_sub_ps(vy, _mm_sub_ps(j, t));
+
+        __m128 lower = _mm_cmpgt_ps(x0, y0);
+        __m128 i1 = _mm_and_ps(lower, one);
+        __m128 j1 = _mm_sub_ps(one, i1);
+        __m128 x1 = _mm_add_ps(_mm_sub_ps(x0, i1), unskew);
+        __m128 y1 = _mm_add_ps(_mm_sub_ps(y0, j1), unskew);
+        __m128 x2 = _mm_add_ps(_mm_sub_ps(x0, one), unskew2);
+        __m128 y2 = _mm_add_ps(_mm_sub_ps(y0, one), unskew2);
+
+        __m128i I = _mm_cvttps_epi32(i);
+        __m128i J = _mm_cvttps_epi32(j);
+        __m128i I1 = _mm_and_si128(_mm_castps_si128(lower), ones);
+        __m128 n = _mm_add_ps(simplexCorners(hashCorners(seeds, I, J), x0, y0),
+                              simplexCorners(hashCorners(seeds, _mm_add_epi32(I, I1), _mm_add_epi32(J, _mm_sub_epi32(ones, I1))), x1, y1));
+        n = _mm_add_ps(n, simplexCorners(hashCorners(seeds, _mm_add_epi32(I, ones), _mm_add_epi32(J, ones)), x2, y2));
+        _mm_storeu_ps(values + k, _mm_mul_ps(_mm_set1_ps(SIMPLEX_SCALE), n));
+    }
+#endif
+    // Remaining samples, or all of them in the scalar build
+    for (; k < count; k++)
+        values[k] = simplexSample(seed, x[k], y[k]);
+}
+
+static void fixedNoise(std::uint32_t seed, const std::uint32_t* x, const std::uint32_t* y, std::int32_t* values, std::size_t count)
+{
+    std::size_t k = 0;
+#if KERNEL_LEVEL >= 3
+    // Same operations as fixedSample(), eight samples per iteration
+    {
+        const __m256i seeds = _mm256_set1_epi32(static_cast<int>(seed));
+        const __m256i ones = _mm256_set1_epi32(1);
+        const __m256i fraction = _mm256_set1_epi32(FIXED_NOISE_ONE - 1);
+        const __m256i one = _mm256_set1_epi32(FIXED_NOISE_ONE);
+        for (; k + 8 <= count; k += 8) {
+            __m256i vx = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(x + k));
+            __m256i vy = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(y + k));
+            __m256i X = _mm256_srli_epi32(vx, FIXED_NOISE_BITS);
+            __m256i Y = _mm256_srli_epi32(vy, FIXED_NOISE_BITS);
+            __m256i fx = _mm256_and_si256(vx, fraction);
+            __m256i fy = _mm256_and_si256(vy, fraction);
+            __m256i u = fixedFades8(_mm256_srli_epi32(fx, FIXED_NOISE_BITS - FIXED_FADE_BITS));
+            __m256i v = fixedFades8(_mm256_srli_epi32(fy, FIXED_NOISE_BITS - FIXED_FADE_BITS));
+            __m256i gx = _mm256_sub_epi32(fx, one);
+            __m256i gy = _mm256_sub_epi32(fy, one);
+            __m256i X1 = _mm256_add_epi32(X, ones);
+            __m256i Y1 = _mm256_add_epi32(Y, ones);
+            __m256i low = fixedLerps8(u, fixedGrads8(hashCorners8(seeds, X, Y), fx, fy), fixedGrads8(hashCorners8(seeds, X1, Y), gx, fy));
+            __m256i high = fixedLerps8(u, fixedGrads8(hashCorners8(seeds, X, Y1), fx, gy), fixedGrads8(hashCorners8(seeds, X1, Y1), gx, gy));
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(values + k), fixedLerps8(v, low, high));
+        }
+    }
+#endif
+#if KERNEL_LEVEL >= 1
+    // Four samples per iteration, the whole batch below AVX2 or the remainder above it
+    const __m128i seeds = _mm_set1_epi32(static_cast<int>(seed));
+    const __m128i ones = _mm_set1_epi32(1);
+    const __m128i fraction = _mm_set1_epi32(FIXED_NOISE_ONE - 1);
+    const __m128i one = _mm_set1_epi32(FIXED_NOISE_ONE);
+    for (; k + 4 <= count; k += 4) {
+        __m128i vx = _mm_loadu_si128(reinterpret_cast<const __m128i*>(x + k));
+        __m128i vy = _mm_loadu_si128(reinterpret_cast<const __m128i*>(y + k));
+        __m128i X = _mm_srli_epi32(vx, FIXED_NOISE_BITS);
+        __m128i Y = _mm_srli_epi32(vy, FIXED_NOISE_BITS);
+        __m128i fx = _mm_and_si128(vx, fraction);
+        __m128i fy = _mm_and_si128(vy, fraction);
+        __m128i u = fixedFades(_mm_srli_epi32(fx, FIXED_NOISE_BITS - FIXED_FADE_BITS));
+        __m128i v = fixedFades(_mm_srli_epi32(fy, FIXED_NOISE_BITS - FIXED_FADE_BITS));
+        __m128i gx = _mm_sub_epi32(fx, one);
+        __m128i gy = _mm_sub_epi32(fy, one);
+        __m128i X1 = _mm_add_epi32(X, ones);
+        __m128i Y1 = _mm_add_epi32(Y, ones);
+        __m128i low = fixedLerps(u, fixedGrads(hashCorners(seeds, X, Y), fx, fy), fixedGrads(hashCorners(seeds, X1, Y), gx, fy));
+        __m128i high = fixedLerps(u, fixedGrads(hashCorners(seeds, X, Y1), fx, gy), fixedGrads(hashCorners(seeds, X1, Y1), gx, gy));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(values + k), fixedLerps(v, low, high));
+    }
+#endif
+    for (; k < count; k++)
+        values[k] = fixedSample(seed, x[k], y[k]);
+}
+
+static void encodeNormalRow(const float* row, int width, float heightScale, unsigned char* texels)
+{
+    const float* down = row - width;
+    const float* up = row + width;
+    int x = 1;
+#if KERNEL_LEVEL >= 3
+    // Eight texels per iteration, stored as two groups of four
+    {
+        const __m256 scales = _mm256_set1_ps(heightScale);
+        const __m256 four = _mm256_set1_ps(4.0f);
+        const __m256 one = _mm256_set1_ps(1.0f);
+        for (; x + 8 <= width - 1; x += 8) {
+            __m256 nx = _mm256_sub_ps(_mm256_mul_ps(_mm256_loadu_ps(row + x - 1), scales), _mm256_mul_ps(_mm256_loadu_ps(row + x + 1), scales));
+            __m256 nz = _mm256_sub_ps(_mm256_mul_ps(_mm256_loadu_ps(down + x), scales), _mm256_mul_ps(_mm256_loadu_ps(up + x), scales));
+            __m256 inverse = _mm256_div_ps(one, _mm256_sqrt_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(nx, nx), four), _mm256_mul_ps(nz, nz))));
+            __m256i ex = encodeComponents8(_mm256_mul_ps(nx, inverse));
+            __m256i ez = encodeComponents8(_mm256_mul_ps(nz, inverse));
+            storeTexels(_mm256_castsi256_si128(ex), _mm256_castsi256_si128(ez), texels + 2 * x);
+            storeTexels(_mm256_extracti128_si256(ex, 1), _mm256_extracti128_si256(ez, 1), texels + 2 * x + 8);
+        }
+    }
+#endif
+#if KERNEL_LEVEL >= 1
+    // Four texels per iteration, same operations as encodeNormalTexel
+    const __m128 scales = _mm_set1_ps(heightScale);
+    const __m128 four = _mm_set1_ps(4.0f);
+    const __m128 one = _mm_set1_ps(1.0f);
+    for (; x + 4 <= width - 1; x += 4) {
+        __m128 nx = _mm_sub_ps(_mm_mul_ps(_mm_loadu_ps(row + x - 1), scales), _mm_mul_ps(_mm_loadu_ps(row + x + 1), scales));
+        __m128 nz = _mm_sub_ps(_mm_mul_ps(_mm_loadu_ps(down + x), scales), _mm_mul_ps(_mm_loadu_ps(up + x), scales));
+        __m128 inverse = _mm_div_ps(one, _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, nx), four), _mm_mul_ps(nz, nz))));
+        storeTexels(encodeComponents(_mm_mul_ps(nx, inverse)), encodeComponents(_mm_mul_ps(nz, inverse)), texels + 2 * x);
+    }
+#endif
+    for (; x < width - 1; x++)
+        encodeNormalTexel(row[x - 1] * heightScale, row[x + 1] * heightScale, down[x] * heightScale, up[x] * heightScale, texels + 2 * x);
+}
+
+const Kernels table = {static_cast<CpuIsa>(KERNEL_LEVEL), dequantizeHeights, simplexNoise, encodeNormalRow, fixedNoise};
+
+} // namespace KERNEL_NAMESPACE
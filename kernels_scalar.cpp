@@ -0,0 +1,19 @@
+// Portable kernels, the fallback on every architecture and the reference the vector builds match
+#define KERNEL_NAMESPACE scalar
+#define KERNEL_LEVEL 0
+#include "kernels_impl.h"
+
+const Kernels* scalarKernels()
+{
+    return &scalar::table;
+}
+
+float simplexNoise(std::uint32_t seed, float x, float y)
+{
+    return scalar::simplexSample(seed, x, y);
+}
+
+std::int32_t fixedNoise(std::uint32_t seed, std::uint32_t x, std::uint32_t y)
+{
+    return scalar::fixedSample(seed, x, y);
+}
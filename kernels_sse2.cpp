@@ -0,0 +1,18 @@
+// SSE2 kernels, built with -msse2 on x86 (see makefile) and left empty on other targets
+#if defined(__SSE2__)
+#define KERNEL_NAMESPACE sse2
+#define KERNEL_LEVEL 1
+#include "kernels_impl.h"
+
+const Kernels* sse2Kernels()
+{
+    return &sse2::table;
+}
+#else
+#include "kernels.h"
+
+const Kernels* sse2Kernels()
+{
+    return nullptr;
+}
+#endif
@@ -0,0 +1,18 @@
+// SSE4.1 kernels, built with -msse4.1 on x86 (see makefile) and left empty on other targets
+#if defined(__SSE4_1__)
+#define KERNEL_NAMESPACE sse41
+#define KERNEL_LEVEL 2
+#include "kernels_impl.h"
+
+const Kernels* sse41Kernels()
+{
+    return &sse41::table;
+}
+#else
+#include "kernels.h"
+
+const Kernels* sse41Kernels()
+{
+    return nullptr;
+}
+#endif
@@ -4,12 +4,18 @@
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
 #include <iostream>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <algorithm>
 
 // My headers
 #include "shaders.h"
 #include "perlin.h"
 #include "window.h"
 #include "terrain.h"
+#include "kernels.h"
+#include "buffers.h"
 
 // Globals
 double lastTime = 0.0;
@@ -17,86 +23,146 @@ int nbFrames = 0;
 // For lighting
 glm::vec3 lightPos(50.0f, 100.0f, 50.0f);  // Adjust as needed
 glm::vec3 lightColor(1.0f, 1.0f, 1.0f);    // White light
+// Samples per side of the grid corner the startup ACMR is measured on
+const int ACMR_SAMPLE_SIZE = 256;
 
 
-int main()
+int main(int argc, char** argv)
 {
+    // Generation settings, later changed with T or the command console
+    TerrainParams params;
+
+    // Command line options
+    for (int i = 1; i < argc; i++) {
+        if (std::strcmp(argv[i], "--image") == 0 && i + 1 < argc) {
+            params.mode = TerrainMode::HEIGHTMAP_IMAGE; // Starts from a height map image
+            params.heightMapFile = argv[++i];
+        } else if (std::strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+            params.seed = static_cast<unsigned int>(std::strtoul(argv[++i], nullptr, 10)); // Reproducible Perlin terrain
+        } else if (std::strcmp(argv[i], "--normal-map") == 0) {
+            renderPath = RenderPath::NORMAL_MAP; // Normals in a texture instead of the VBO
+        } else if (std::strcmp(argv[i], "--height-texture") == 0) {
+            renderPath = RenderPath::HEIGHT_TEXTURE; // Shared patch mesh displaced from a height texture
+        } else if (std::strcmp(argv[i], "--height-scale") == 0 && i + 1 < argc) {
+            params.heightScale = std::strtof(argv[++i], nullptr); // Vertical exaggeration
+        } else if (std::strcmp(argv[i], "--noise-scale") == 0 && i + 1 < argc) {
+            params.noiseScale = std::strtof(argv[++i], nullptr); // Perlin frequency, smaller is smoother
+        } else if (std::strcmp(argv[i], "--noise-engine") == 0 && i + 1 < argc) {
+            const char* engine = argv[++i];
+            if (std::strcmp(engine, "hash") == 0) params.noiseEngine = NoiseEngine::HASH; // Table-free, no 256-unit period
+            else if (std::strcmp(engine, "simplex") == 0) params.noiseEngine = NoiseEngine::SIMPLEX; // 3 corners per sample
+            else if (std::strcmp(engine, "fixed") == 0) params.noiseEngine = NoiseEngine::FIXED; // Integer, reproducible everywhere
+            else if (std::strcmp(engine, "perlin") == 0) params.noiseEngine = NoiseEngine::PERLIN;
+            else {
+                std::cerr << "Unknown noise engine: " << engine << std::endl;
+                return -1;
+            }
+        } else if (std::strcmp(argv[i], "--bench-noise") == 0) {
+            benchmarkNoise(params.seed ? params.seed : 1); // Prints engine throughput without opening a window
+            return 0;
+        } else if (std::strcmp(argv[i], "--verify-noise") == 0) {
+            return verifyNoise() ? 0 : 1; // Checks fixed-point noise and height conversion against their golden hashes
+        } else if (std::strcmp(argv[i], "--octave-error") == 0 && i + 1 < argc) {
+            params.octaveError = std::strtof(argv[++i], nullptr); // Skips fine octaves within this error
+        } else if (std::strcmp(argv[i], "--multigrid-error") == 0 && i + 1 < argc) {
+            params.multigridError = std::strtof(argv[++i], nullptr); // Low octaves on coarse grids within this error
+        } else if (std::strcmp(argv[i], "--chunked") == 0) {
+            renderPath = RenderPath::CHUNKED; // Pooled chunks drawn with multi-draw indirect
+        } else {
+            std::cerr << "Unknown option: " << argv[i] << std::endl;
+            return -1;
+        }
+    }
+    if (!(params.heightScale > 0.0f) || !(params.noiseScale > 0.0f)) {
+        std::cerr << "Height and noise scales must be positive" << std::endl;
+        return -1;
+    }
+
     // Spawns window
     GLFWwindow* window = initializeWindow();
     if (!window) return -1;
 
-    // Creates shaders
-    GLuint shaderProgram = createShaderProgram();
+    // Creates shaders, cold compiles keep running while the terrain is generated below
+    PendingShaderProgram pendingProgram, pendingNormalProgram;
+    if (renderPath == RenderPath::NORMAL_MAP) {
+        pendingProgram = createNormalMapShaderProgram();
+        pendingNormalProgram = createNormalMapNormalShaderProgram(); // Shader for normals
+    } else if (renderPath == RenderPath::HEIGHT_TEXTURE) {
+        pendingProgram = createHeightTextureShaderProgram();
+        pendingNormalProgram = createHeightTextureNormalShaderProgram(); // Shader for normals
+    } else {
+        pendingProgram = createShaderProgram();
+        pendingNormalProgram = createNormalShaderProgram(); // Shader for normals
+    }
     glClearColor(0.2f, 0.3f, 0.3f, 1.0f); // Sets window background color
-
-    // Shader for normals
-    GLuint normalShaderProgram = createNormalShaderProgram();
     glm::vec3 lightColor(1.0f, 1.0f, 1.0f);    // White light for light source
 
-    // User prompting
-    TerrainMode mode;
-    char choice;
-    std::cout << "Choose terrain generation mode:" << std::endl;
-    std::cout << "1. Random generation (Perlin noise)" << std::endl;
-    std::cout << "2. Load from default image" << std::endl;
-    std::cout << "3. Load from custom image file" << std::endl;
-    std::cout << "Enter your choice (1, 2, or 3): ";
-    std::cin >> choice;
-
     // Data for terrain generation
-    std::vector<float> vertices;
-    std::vector<unsigned int> indices;
-
-    if (choice == '1') {
-        mode = TerrainMode::PERLIN_NOISE;
-        generateTerrain(vertices, indices, mode);
-    } else if (choice == '2') {
-        mode = TerrainMode::HEIGHTMAP_IMAGE;
-        std::string defaultImagePath = "./resources/HeightMapIsland.jpg";
-        generateTerrain(vertices, indices, mode, defaultImagePath.c_str());
-    } else if (choice == '3') {
-        mode = TerrainMode::HEIGHTMAP_IMAGE;
-        std::string imagePath;
-        std::cout << "Enter the file path of the image: ";
-        std::cin >> imagePath;
-        generateTerrain(vertices, indices, mode, imagePath.c_str());
-    } else {
-        std::cerr << "Invalid choice. Exiting." << std::endl;
+    TerrainData terrain;
+    generateTerrainData(terrain, renderPath, params);
+
+    // Waits for any links still in flight, keeping the window responsive
+    while (!shaderProgramReady(pendingProgram) || !shaderProgramReady(pendingNormalProgram))
+        glfwWaitEventsTimeout(0.001);
+    ShaderProgram shaderProgram = finishShaderProgram(pendingProgram);
+    ShaderProgram normalShaderProgram = finishShaderProgram(pendingNormalProgram);
+    if (!shaderProgram.id || !normalShaderProgram.id) {
+        std::cerr << "Failed to build shaders. Exiting." << std::endl;
         return -1;
     }
 
+    // Constant uniforms are set once, patch size only exists in the height texture shaders
+    if (shaderProgram.patchSize >= 0) {
+        glUseProgram(shaderProgram.id);
+        glUniform1i(shaderProgram.patchSize, PATCH_SIZE);
+    }
+    if (normalShaderProgram.patchSize >= 0) {
+        glUseProgram(normalShaderProgram.id);
+        glUniform1i(normalShaderProgram.patchSize, PATCH_SIZE);
+    }
+
+    // Camera and light are shared by both programs through one uniform buffer
+    GLuint frameUniformBuffer = createFrameUniformBuffer();
+    FrameUniforms frame;
+
     // Error checking
-    if (vertices.empty() || indices.empty()) {
+    if (!hasTerrain(terrain)) {
         std::cerr << "Failed to generate terrain. Exiting." << std::endl;
         return -1;
     }
 
     // Logging
     std::cout << "Terrain generated successfully." << std::endl;
-    std::cout << "Vertices: " << vertices.size() / 6 << std::endl;
-    std::cout << "Indices: " << indices.size() << std::endl;
+    std::cout << "Kernels: " << cpuIsaName(kernels().isa) << std::endl;
+    if (renderPath == RenderPath::HEIGHT_TEXTURE) {
+        std::cout << "Height texture: " << terrain.width << "x" << terrain.height << " R16" << std::endl;
+    } else {
+        // The mesh itself is only ever written into GPU memory. The band order repeats across the grid,
+        // so the cache metric is measured on a small corner instead of a CPU copy of every index.
+        int sampleSize = std::min(std::min(terrain.width, terrain.height), ACMR_SAMPLE_SIZE);
+        std::vector<unsigned int> indices;
+        generateGridIndices(indices, sampleSize, sampleSize);
+        std::cout << "Vertices: " << terrain.width * terrain.height << std::endl;
+        std::cout << "Indices: " << gridIndexCount(terrain.width, terrain.height) << std::endl;
+        std::cout << "ACMR: " << averageCacheMissRatio(indices) << " vertex shader runs per triangle" << std::endl;
+        if (renderPath == RenderPath::NORMAL_MAP)
+            std::cout << "Normal map: " << terrain.width << "x" << terrain.height << " RG8" << std::endl;
+    }
 
     // Set up vertex data, buffers, and their pointers
-    GLuint VAO, VBO, EBO;
-    glGenVertexArrays(1, &VAO); // Generates 1 VAO object
-    glGenBuffers(1, &VBO); // Generates 1 VBO object
-    glGenBuffers(1, &EBO); // Generates 1 EBO object
-
-    glBindVertexArray(VAO); // Binds VAO object
-
-    glBindBuffer(GL_ARRAY_BUFFER, VBO); // Binds VBO object
-    glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(float), vertices.data(), GL_STATIC_DRAW); // Copies vertices to buffer
-
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO); // Binds EBO object
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), indices.data(), GL_STATIC_DRAW); // Copies indices to buffer
+    TerrainBuffers buffers;
+    createTerrainBuffers(buffers, terrain, renderPath);
+    if (renderPath == RenderPath::CHUNKED)
+        std::cout << "Chunks: " << buffers.chunked.chunks.size() << " (" << CHUNK_SIZE << "x" << CHUNK_SIZE << " cells)" << std::endl;
 
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (void*)0); // Position attribute
-    glEnableVertexAttribArray(0); // Enables vertex attribute
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (void*)(3 * sizeof(float))); // Normal attribute
-    glEnableVertexAttribArray(1); // Enables vertex attribute
+    // Background terrain regeneration, driven by T and the command console
+    TerrainWorker worker;
+    CommandConsole console;
+    std::cout << "Type help for console commands." << std::endl;
 
-    GLuint lightPosLoc = glGetUniformLocation(shaderProgram, "lightPos"); // Gets lightPos uniform location
-    GLuint viewPosLoc = glGetUniformLocation(shaderProgram, "viewPos"); // Gets viewPos uniform location
+    // The model never moves, so its normal matrix is computed once instead of per vertex
+    glm::mat4 model = glm::mat4(1.0f); // Model matrix
+    glm::mat3 normalMatrix = glm::mat3(glm::transpose(glm::inverse(model)));
 
     // Main render loop
     while (!glfwWindowShouldClose(window))
@@ -109,59 +175,78 @@ int main()
             double ms_per_frame = 1000.0 / double(nbFrames); // Calculates time per frame in milliseconds
             double fps = double(nbFrames) / (currentTime - lastTime); // Calculates frames per second
             printf("%.1f ms/frame (%.1f FPS)\n", ms_per_frame, fps); // Prints FPS
+            if (worker.busy()) printf("Regenerating terrain: %.0f%%\n", worker.progress() * 100.0f); // Prints generation progress
             nbFrames = 0; // Resets frame count
             lastTime += 1.0; // Increments lastTime by 1 second
         }
 
         // Tracks mouse and keyboard input in the window
-        processInput(window, mode, vertices, indices, VAO, VBO, EBO);
+        processInput(window, params, worker);
+        processCommands(window, console, params, worker);
+
+        // Swaps in a finished terrain between frames, the old one is drawn until then
+        if (worker.poll(terrain)) {
+            uploadTerrain(buffers, terrain, renderPath);
+            std::cout << "Terrain regenerated." << std::endl;
+        }
+
+        // Scale changes reuse the cached heightfield, the noise is not evaluated again
+        if (hasTerrain(terrain) && terrain.heightScale != params.heightScale)
+            rescaleTerrain(buffers, terrain, renderPath, params.heightScale);
 
         // Clear the screen/buffers
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-        // Use the shader program
-        glUseProgram(shaderProgram);
-
         glm::vec3 lightPos = glm::vec3(50.0f, 200.0f, 50.0f); // Adjust as needed
         glm::mat4 view = glm::lookAt(cameraPos, cameraPos + cameraFront, cameraUp); // Camera view matrix
         glm::mat4 projection = glm::perspective(glm::radians(45.0f), 800.0f / 600.0f, 0.1f, 1000.0f); // Camera projection matrix
-        glm::mat4 model = glm::mat4(1.0f); // Model matrix
 
-        // Matrix uniforms
-        glUniformMatrix4fv(glGetUniformLocation(shaderProgram, "model"), 1, GL_FALSE, glm::value_ptr(model)); // Sets model matrix
-        glUniformMatrix4fv(glGetUniformLocation(shaderProgram, "view"), 1, GL_FALSE, glm::value_ptr(view)); // Sets view matrix
-        glUniformMatrix4fv(glGetUniformLocation(shaderProgram, "projection"), 1, GL_FALSE, glm::value_ptr(projection)); // Sets projection matrix
-        glUniform3fv(lightPosLoc, 1, glm::value_ptr(lightPos)); // Sets light position uniform
-        glUniform3fv(glGetUniformLocation(shaderProgram, "lightColor"), 1, glm::value_ptr(lightColor)); // Sets light color uniform
-        glUniform3fv(viewPosLoc, 1, glm::value_ptr(cameraPos)); // Sets view position uniform
+        // Per-frame uniforms, uploaded once for both programs
+        frame.view = view;
+        frame.projection = projection;
+        frame.viewPos = glm::vec4(cameraPos, 1.0f);
+        frame.lightPos = glm::vec4(lightPos, 1.0f);
+        frame.lightColor = glm::vec4(lightColor, 1.0f);
+        frame.wireframe = wireframeMode ? 1.0f : 0.0f;
+        frame.gridStep = buffers.useChunks ? static_cast<float>(buffers.chunked.step) : 1.0f;
+        frame.heightScale = terrain.heightScale;
+        frame.heightOffset = terrain.quantizedHeights.offset();
+        frame.heightRange = terrain.quantizedHeights.range();
+        updateFrameUniforms(frameUniformBuffer, frame);
+
+        // Texture-based paths sample from texture unit 0
+        glActiveTexture(GL_TEXTURE0);
+        if (renderPath == RenderPath::NORMAL_MAP) glBindTexture(GL_TEXTURE_2D, buffers.normalMapTexture);
+        else if (renderPath == RenderPath::HEIGHT_TEXTURE) glBindTexture(GL_TEXTURE_2D, buffers.heightTexture);
+
+        // Use the shader program
+        useShaderProgram(shaderProgram, model, normalMatrix);
 
-        glBindVertexArray(VAO); // Binds VAO object
-        glDrawElements(GL_TRIANGLES, indices.size(), GL_UNSIGNED_INT, 0); // Draws terrain
+        // Builds this frame's indirect commands from the visible chunks
+        if (buffers.useChunks) cullChunks(buffers.chunked, projection * view * model, buffers.stream);
+
+        drawTerrain(buffers); // Draws terrain
 
         // After rendering the terrain
         if (renderNormals)
         {
-            glUseProgram(normalShaderProgram);
-
-            // Matrix uniforms
-            glUniformMatrix4fv(glGetUniformLocation(normalShaderProgram, "model"), 1, GL_FALSE, glm::value_ptr(model));
-            glUniformMatrix4fv(glGetUniformLocation(normalShaderProgram, "view"), 1, GL_FALSE, glm::value_ptr(view));
-            glUniformMatrix4fv(glGetUniformLocation(normalShaderProgram, "projection"), 1, GL_FALSE, glm::value_ptr(projection));
+            useShaderProgram(normalShaderProgram, model, normalMatrix);
 
-            glBindVertexArray(VAO);
-            glDrawElements(GL_TRIANGLES, indices.size(), GL_UNSIGNED_INT, 0);
+            drawTerrainPoints(buffers); // One normal line per vertex
         }
 
+        // Closes this frame's region of the streaming ring
+        finishTerrainFrame(buffers);
+
         glfwSwapBuffers(window);
         glfwPollEvents();
     }
 
     // Clean-up
-    glDeleteVertexArrays(1, &VAO);
-    glDeleteBuffers(1, &VBO);
-    glDeleteBuffers(1, &EBO);
-    glDeleteProgram(shaderProgram);
-    glDeleteProgram(normalShaderProgram);
+    deleteTerrainBuffers(buffers);
+    deleteShaderProgram(shaderProgram);
+    deleteShaderProgram(normalShaderProgram);
+    glDeleteBuffers(1, &frameUniformBuffer);
 
     // End program
     glfwTerminate();
@@ -3,6 +3,11 @@
 #include <numeric>
 #include <random>
 #include <cmath>
+#include <cstring>
+#include <chrono>
+#include <iostream>
+#include <string>
+#include "kernels.h"
 
 // Constructor for PerlinNoise class
 PerlinNoise::PerlinNoise()
@@ -15,6 +20,16 @@ PerlinNoise::PerlinNoise()
     p.insert(p.end(), p.begin(), p.end()); // Copies the elements from the vector to the end of the vector
 }
 
+// Seeded constructor, same permutation for the same seed
+PerlinNoise::PerlinNoise(unsigned int seed)
+{
+    p.resize(256);
+    std::iota(p.begin(), p.end(), 0);
+    std::mt19937 g(seed);
+    std::shuffle(p.begin(), p.end(), g);
+    p.insert(p.end(), p.begin(), p.end());
+}
+
 double PerlinNoise::noise(double x, double y, double z)
 {
     // Gets the integers of the coordinates
@@ -76,22 +91,288 @@ double PerlinNoise::grad(int hash, double x, double y, double z)
     return ((h & 1) == 0 ? u : -u) + ((h & 2) == 0 ? v : -v);
 }
 
-float octavePerlin(PerlinNoise& pn, float x, float y, int octaves, float persistence) {
-    float total = 0;  // Accumulator for the final noise value
-    float frequency = 1;  // Frequency of the current octave
-    float amplitude = 1;  // Amplitude of the current octave
-    float maxValue = 0;  // Max possible amplitude
+HashNoise::HashNoise() : seed(std::random_device()())
+{
+}
+
+HashNoise::HashNoise(unsigned int seed) : seed(seed)
+{
+}
+
+double HashNoise::noise(double x, double y) const
+{
+    // Lattice cell, wrapped to 32 bits so coordinates far from the origin keep their own gradients
+    double fx = std::floor(x);
+    double fy = std::floor(y);
+    std::uint32_t X = static_cast<std::uint32_t>(static_cast<std::int64_t>(fx));
+    std::uint32_t Y = static_cast<std::uint32_t>(static_cast<std::int64_t>(fy));
+
+    // Position inside the cell
+    x -= fx;
+    y -= fy;
+
+    // Calculates interpolation factors, the same quintic fade as PerlinNoise
+    double u = PerlinNoise::fade(x);
+    double v = PerlinNoise::fade(y);
+
+    // Interpolates the gradient values of the four corners
+    return PerlinNoise::lerp(v, PerlinNoise::lerp(u, grad(hashCorner(seed, X, Y), x, y),
+                                                     grad(hashCorner(seed, X + 1, Y), x - 1, y)),
+                                PerlinNoise::lerp(u, grad(hashCorner(seed, X, Y + 1), x, y - 1),
+                                                     grad(hashCorner(seed, X + 1, Y + 1), x - 1, y - 1)));
+}
+
+double HashNoise::grad(std::uint32_t hash, double x, double y)
+{
+    // Extracts the lower 3 bits: diagonals (+-1, +-1) for 0-3, (+-1, 0) for 4-5 and (0, +-1) for 6-7
+    std::uint32_t h = hash & 7;
+    double u = h < 6 ? x : y;
+    double v = h < 4 ? y : 0.0;
+
+    // Dot product with the selected gradient, the signs come from the low bits
+    return ((h & 1) == 0 ? u : -u) + ((h & 2) == 0 ? v : -v);
+}
+
+SimplexNoise::SimplexNoise() : seed(std::random_device()())
+{
+}
+
+SimplexNoise::SimplexNoise(unsigned int seed) : seed(seed)
+{
+}
+
+double SimplexNoise::noise(double x, double y) const
+{
+    return simplexNoise(seed, static_cast<float>(x), static_cast<float>(y));
+}
+
+void SimplexNoise::noise(const float* x, const float* y, float* values, std::size_t count) const
+{
+    kernels().simplexNoise(seed, x, y, values, count);
+}
+
+FixedNoise::FixedNoise() : seed(std::random_device()())
+{
+}
+
+FixedNoise::FixedNoise(unsigned int seed) : seed(seed)
+{
+}
+
+std::int32_t FixedNoise::sample(std::uint32_t x, std::uint32_t y) const
+{
+    return fixedNoise(seed, x, y);
+}
+
+void FixedNoise::sample(const std::uint32_t* x, const std::uint32_t* y, std::int32_t* values, std::size_t count) const
+{
+    kernels().fixedNoise(seed, x, y, values, count);
+}
+
+void FixedNoise::octaveSample(const std::uint32_t* x, const std::uint32_t* y, std::int32_t* values, std::size_t count, int octaves, int evaluatedOctaves) const
+{
+    // Octave i doubles the frequency by shifting the coordinates and halves the amplitude. Amplitudes are
+    // scaled by 2^(octaves - 1) to stay integers, so the total is divided by 2^octaves - 1.
+    std::vector<std::int64_t> totals(count, 0);
+    std::vector<std::uint32_t> octaveX(count), octaveY(count);
+    std::vector<std::int32_t> octave(count);
+    for (int i = 0; i < evaluatedOctaves; i++) {
+        for (std::size_t k = 0; k < count; k++) {
+            octaveX[k] = x[k] << i;
+            octaveY[k] = y[k] << i;
+        }
+        sample(octaveX.data(), octaveY.data(), octave.data(), count);
+        std::int64_t amplitude = std::int64_t(1) << (octaves - 1 - i);
+        for (std::size_t k = 0; k < count; k++) totals[k] += octave[k] * amplitude;
+    }
+    std::int64_t maxValue = (std::int64_t(1) << octaves) - 1;
+    for (std::size_t k = 0; k < count; k++) values[k] = static_cast<std::int32_t>(totals[k] / maxValue);
+}
+
+double FixedNoise::noise(double x, double y) const
+{
+    return static_cast<double>(sample(toFixed(x), toFixed(y))) / FIXED_NOISE_ONE;
+}
+
+std::uint32_t FixedNoise::toFixed(double coordinate)
+{
+    // Scaling by a power of two and flooring are exact, the conversions wrap modulo 2^32
+    return static_cast<std::uint32_t>(static_cast<std::int64_t>(std::floor(coordinate * FIXED_NOISE_ONE)));
+}
+
+// Runs one engine over the same row of coordinates until at least 0.2 s have passed
+template <typename Evaluate>
+static void benchmarkEngine(const char* name, const std::vector<float>& xs, const std::vector<float>& ys, std::vector<float>& values, Evaluate evaluate)
+{
+    typedef std::chrono::steady_clock Clock;
+    Clock::time_point start = Clock::now();
+    double seconds = 0.0;
+    size_t samples = 0;
+    size_t runs = 0;
+    float checksum = 0.0f; // Keeps the results observable so nothing is optimized away
+    while (seconds < 0.2) {
+        evaluate(xs, ys, values);
+        samples += values.size();
+        checksum += values[runs++ * 97 % values.size()];
+        seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    }
+    std::cout << "  " << name << ": " << samples / seconds / 1e6 << " Msamples/s (checksum " << checksum << ")" << std::endl;
+}
+
+void benchmarkNoise(unsigned int seed)
+{
+    // One 4096-sample strip at terrain-like spacing, small enough to stay in cache
+    const size_t count = 4096;
+    std::vector<float> xs(count), ys(count), values(count);
+    for (size_t i = 0; i < count; i++) {
+        xs[i] = (i % 64) * 0.03f;
+        ys[i] = (i / 64) * 0.03f;
+    }
 
-    // Iterates over the octaves
-    for(int i = 0; i < octaves; i++) {
-        // Calculates noise value for the current octave
-        total += pn.noise(x * frequency, y * frequency, 0.5) * amplitude;
+    PerlinNoise perlin(seed);
+    HashNoise hash(seed);
+    SimplexNoise simplex(seed);
+    FixedNoise fixed(seed);
+    std::cout << "Noise throughput, single octave:" << std::endl;
+    benchmarkEngine("perlin scalar", xs, ys, values, [&](const std::vector<float>& x, const std::vector<float>& y, std::vector<float>& out) {
+        for (size_t i = 0; i < out.size(); i++) out[i] = static_cast<float>(perlin.noise(x[i], y[i]));
+    });
+    benchmarkEngine("hash scalar", xs, ys, values, [&](const std::vector<float>& x, const std::vector<float>& y, std::vector<float>& out) {
+        for (size_t i = 0; i < out.size(); i++) out[i] = static_cast<float>(hash.noise(x[i], y[i]));
+    });
+    benchmarkEngine("fixed scalar", xs, ys, values, [&](const std::vector<float>& x, const std::vector<float>& y, std::vector<float>& out) {
+        for (size_t i = 0; i < out.size(); i++) out[i] = static_cast<float>(fixed.noise(x[i], y[i]));
+    });
+    benchmarkEngine("simplex scalar", xs, ys, values, [&](const std::vector<float>& x, const std::vector<float>& y, std::vector<float>& out) {
+        for (size_t i = 0; i < out.size(); i++) out[i] = static_cast<float>(simplex.noise(x[i], y[i]));
+    });
 
-        maxValue += amplitude; // Updates the max possible amplitude
-        amplitude *= persistence; // Reduces the amplitude of the next octave
-        frequency *= 2; // Increases the frequency of the next octave
+    // Fixed-point batches take the same strip as 16.16 coordinates, their integer results are copied out
+    std::vector<std::uint32_t> fixedXs(count), fixedYs(count);
+    std::vector<std::int32_t> fixedValues(count);
+    for (size_t i = 0; i < count; i++) {
+        fixedXs[i] = FixedNoise::toFixed(xs[i]);
+        fixedYs[i] = FixedNoise::toFixed(ys[i]);
     }
 
-    // Normalizes the total noise value by the max possible amplitude
-    return total / maxValue;
+    // Every kernel build the CPU supports, the one selected for generation is marked
+    for (int isa = 0; isa <= static_cast<int>(CpuIsa::AVX2); isa++) {
+        const Kernels* table = kernelsFor(static_cast<CpuIsa>(isa));
+        if (!table) continue;
+        std::string suffix = std::string(cpuIsaName(table->isa)) + (table == &kernels() ? " (selected)" : "");
+        benchmarkEngine(("simplex batch " + suffix).c_str(), xs, ys, values, [&](const std::vector<float>& x, const std::vector<float>& y, std::vector<float>& out) {
+            table->simplexNoise(seed, x.data(), y.data(), out.data(), out.size());
+        });
+        benchmarkEngine(("fixed batch " + suffix).c_str(), xs, ys, values, [&](const std::vector<float>&, const std::vector<float>&, std::vector<float>& out) {
+            table->fixedNoise(seed, fixedXs.data(), fixedYs.data(), fixedValues.data(), out.size());
+            for (size_t i = 0; i < out.size(); i++) out[i] = static_cast<float>(fixedValues[i]);
+        });
+    }
+}
+
+// FNV-1a over the bytes of values, least significant first so the hash ignores the host's byte order
+static std::uint64_t hashValues(const std::vector<std::int32_t>& values)
+{
+    std::uint64_t hash = 0xcbf29ce484222325ull;
+    for (std::int32_t value : values) {
+        std::uint32_t bits = static_cast<std::uint32_t>(value);
+        for (int byte = 0; byte < 4; byte++) {
+            hash ^= (bits >> (8 * byte)) & 0xff;
+            hash *= 0x100000001b3ull;
+        }
+    }
+    return hash;
+}
+
+static bool checkGolden(const char* name, const std::vector<std::int32_t>& values, std::uint64_t golden)
+{
+    std::uint64_t hash = hashValues(values);
+    std::cout << "  " << name << ": " << std::hex << hash << std::dec << (hash == golden ? " ok" : " MISMATCH") << std::endl;
+    return hash == golden;
+}
+
+// Hashes of the verification set below, recorded once. Any change to fixed-point noise must update them
+// deliberately, since it changes every terrain generated with --noise-engine fixed.
+const std::uint64_t FIXED_NOISE_GOLDEN = 0xb772a400634fee89ull;
+const std::uint64_t FIXED_OCTAVES_GOLDEN = 0x7c3eec6f97b09fa3ull;
+// Every variant converting every 16-bit height to the scalar code's float, bit for bit
+const std::uint64_t DEQUANTIZE_GOLDEN = 0x294be1ccf2e91d20ull;
+
+// Bit patterns of heights, so float results go through the same hash as the integer ones
+static std::vector<std::int32_t> heightBits(const std::vector<float>& heights)
+{
+    std::vector<std::int32_t> bits(heights.size());
+    std::memcpy(bits.data(), heights.data(), heights.size() * sizeof(float));
+    return bits;
+}
+
+bool verifyNoise()
+{
+    // Coordinates spread over the whole 32-bit range, with odd counts so every kernel runs its scalar tail
+    const size_t count = 4099;
+    const unsigned int seed = 12345;
+    std::vector<std::uint32_t> xs(count), ys(count);
+    for (size_t i = 0; i < count; i++) {
+        xs[i] = static_cast<std::uint32_t>(i) * 0x9e3779b9u;
+        ys[i] = static_cast<std::uint32_t>(i) * 0x85ebca6bu + 0x8000u;
+    }
+
+    FixedNoise noise(seed);
+    std::vector<std::int32_t> values(count);
+    bool matches = true;
+    std::cout << "Fixed-point noise golden hashes:" << std::endl;
+    for (size_t i = 0; i < count; i++) values[i] = noise.sample(xs[i], ys[i]);
+    matches &= checkGolden("scalar", values, FIXED_NOISE_GOLDEN);
+    for (int isa = 0; isa <= static_cast<int>(CpuIsa::AVX2); isa++) {
+        const Kernels* table = kernelsFor(static_cast<CpuIsa>(isa));
+        if (!table) continue;
+        std::fill(values.begin(), values.end(), 0);
+        table->fixedNoise(seed, xs.data(), ys.data(), values.data(), count);
+        matches &= checkGolden((std::string("batch ") + cpuIsaName(table->isa)).c_str(), values, FIXED_NOISE_GOLDEN);
+    }
+    noise.octaveSample(xs.data(), ys.data(), values.data(), count, 6, 6);
+    matches &= checkGolden("6 octaves", values, FIXED_OCTAVES_GOLDEN);
+
+    // Every 16-bit height sample over a [-1, 1] range like the generated noise, plus an odd tail
+    const size_t sampleCount = 65536 + 7;
+    const float scale = 2.0f / 65535;
+    const float offset = -1.0f;
+    std::vector<unsigned short> samples(sampleCount);
+    for (size_t i = 0; i < sampleCount; i++) samples[i] = static_cast<unsigned short>(i * 40503u);
+    std::vector<float> heights(sampleCount);
+    std::cout << "Height dequantization golden hashes:" << std::endl;
+    for (size_t i = 0; i < sampleCount; i++) heights[i] = static_cast<float>(samples[i]) * scale + offset;
+    matches &= checkGolden("scalar", heightBits(heights), DEQUANTIZE_GOLDEN);
+    for (int isa = 0; isa <= static_cast<int>(CpuIsa::AVX2); isa++) {
+        const Kernels* table = kernelsFor(static_cast<CpuIsa>(isa));
+        if (!table) continue;
+        std::fill(heights.begin(), heights.end(), 0.0f);
+        table->dequantizeHeights(samples.data(), sampleCount, scale, offset, heights.data());
+        matches &= checkGolden((std::string("batch ") + cpuIsaName(table->isa)).c_str(), heightBits(heights), DEQUANTIZE_GOLDEN);
+    }
+    std::cout << (matches ? "Fixed-point noise and height conversion are reproducible on this machine." : "Fixed-point noise or height conversion differs from the golden hashes.") << std::endl;
+    return matches;
+}
+
+int octavesForError(int octaves, float persistence, float sampleSpacing, float maxError) {
+    if (maxError <= 0 || octaves <= 1) return octaves;
+
+    // Amplitude of every octave and their sum, the normalization used by octaveNoise
+    std::vector<float> amplitudes(octaves);
+    float maxValue = 0;
+    float amplitude = 1;
+    for (int i = 0; i < octaves; i++) {
+        amplitudes[i] = amplitude;
+        maxValue += amplitude;
+        amplitude *= persistence;
+    }
+
+    // Drops octaves from the finest while the dropped amplitude, relative to the total, stays within the error
+    int count = octaves;
+    float dropped = 0;
+    while (count > 1 && (dropped + amplitudes[count - 1]) / maxValue <= maxError) dropped += amplitudes[--count];
+
+    // Octave i has a wavelength of 1 / 2^i noise units, it needs at least two samples per wavelength
+    while (count > 1 && std::ldexp(sampleSpacing, count - 1) > 0.5f) count--;
+    return count;
 }
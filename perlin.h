@@ -1,13 +1,19 @@
 #pragma once
 
+#include <cstddef>
+#include <cstdint>
 #include <vector>
 
 class PerlinNoise {
 public:
     PerlinNoise();
+    explicit PerlinNoise(unsigned int seed); // Reproducible permutation for a given seed
     double noise(double x, double y, double z);
+    // Terrain slice of the 3D noise, the interface shared by every noise engine
+    double noise(double x, double y) { return noise(x, y, 0.5); }
 
 private:
+    friend class HashNoise; // Shares the fade and interpolation
     std::vector<int> p;
 
     static double fade(double t);
@@ -15,5 +21,133 @@ private:
     static double grad(int hash, double x, double y, double z);
 };
 
-// Function declaration for octave Perlin noise
-float octavePerlin(PerlinNoise& pn, float x, float y, int octaves, float persistence);
+// 2D gradient noise with lattice gradients picked by an integer hash of the cell corner instead of a
+// permutation table. There are no table gathers and no 256-unit period: lattice coordinates wrap at 2^32.
+class HashNoise {
+public:
+    HashNoise();                             // Random seed
+    explicit HashNoise(unsigned int seed);
+    double noise(double x, double y) const;
+
+private:
+    std::uint32_t seed;
+
+    static double grad(std::uint32_t hash, double x, double y);
+};
+
+// 2D simplex noise on the OpenSimplex2 triangular lattice: 3 corner contributions per sample instead of 4,
+// fewer axis-aligned artifacts. Corner gradients come from the same table-free hash as HashNoise.
+class SimplexNoise {
+public:
+    SimplexNoise();                          // Random seed
+    explicit SimplexNoise(unsigned int seed);
+    double noise(double x, double y) const;
+    // Evaluates count samples at once with the widest kernel the CPU supports (see kernels.h). Results
+    // match noise() on the same float coordinates bit for bit.
+    void noise(const float* x, const float* y, float* values, std::size_t count) const;
+
+private:
+    std::uint32_t seed;
+};
+
+// 2D Perlin noise in integer arithmetic: 16.16 fixed-point coordinates, the corner hash and gradients of
+// HashNoise and a Q12 quintic fade. Only integer adds, multiplies and shifts, so results are bit-identical
+// across compilers, flags, platforms and SIMD widths. Lattice coordinates wrap at 2^16 noise units.
+class FixedNoise {
+public:
+    FixedNoise();                            // Random seed
+    explicit FixedNoise(unsigned int seed);
+    // Value at 16.16 fixed-point coordinates, FIXED_NOISE_ONE (kernels.h) is 1.0
+    std::int32_t sample(std::uint32_t x, std::uint32_t y) const;
+    // Evaluates count samples at once with the widest kernel the CPU supports, equal to sample() bit for bit
+    void sample(const std::uint32_t* x, const std::uint32_t* y, std::int32_t* values, std::size_t count) const;
+    // Fractal sum of the first evaluatedOctaves of octaves with persistence 0.5, normalized by all octaves
+    // like octaveNoise, in integers so the whole sum stays exact
+    void octaveSample(const std::uint32_t* x, const std::uint32_t* y, std::int32_t* values, std::size_t count, int octaves, int evaluatedOctaves) const;
+    // The interface shared by every noise engine, the float templates around it are not bit-exact
+    double noise(double x, double y) const;
+
+    // Nearest fixed-point coordinate at or below coordinate, wrapped to 32 bits
+    static std::uint32_t toFixed(double coordinate);
+
+private:
+    std::uint32_t seed;
+};
+
+// Prints samples per second of every noise engine, scalar and batched, for --bench-noise
+void benchmarkNoise(unsigned int seed);
+// Compares fixed-point noise and 16-bit height conversion from the scalar code and every kernel variant
+// against golden hashes, for --verify-noise. Returns false when any of them differs, i.e. generation is not reproducible here.
+bool verifyNoise();
+
+// Fractal sum of octaves [firstOctave, endOctave) of any noise engine, normalized by all octaves.
+// Coordinates and frequencies stay double: a float coordinate far from the origin keeps too few fraction
+// bits once the finest octave multiplies it.
+template <typename Noise>
+float octaveNoise(Noise& noise, double x, double y, int octaves, float persistence, int firstOctave, int endOctave)
+{
+    float total = 0;  // Accumulator for the final noise value
+    double frequency = 1;  // Frequency of the current octave
+    float amplitude = 1;  // Amplitude of the current octave
+    float maxValue = 0;  // Max possible amplitude
+
+    // Iterates over the octaves, skipped ones still count towards the normalization
+    for(int i = 0; i < octaves; i++) {
+        // Calculates noise value for the current octave
+        if (i >= firstOctave && i < endOctave) total += noise.noise(x * frequency, y * frequency) * amplitude;
+
+        maxValue += amplitude; // Updates the max possible amplitude
+        amplitude *= persistence; // Reduces the amplitude of the next octave
+        frequency *= 2; // Increases the frequency of the next octave
+    }
+
+    // Normalizes the total noise value by the max possible amplitude
+    return total / maxValue;
+}
+
+// Amplitude of an octave, persistence^octave, and the sum over the first octaves as constant expressions.
+// C++11 constexpr functions are a single return, so both recurse; the products and sums are formed in
+// the same order as the runtime loop above, so results match it bit for bit.
+constexpr float octaveAmplitude(float persistence, int octave)
+{
+    return octave == 0 ? 1.0f : octaveAmplitude(persistence, octave - 1) * persistence;
+}
+
+constexpr float octaveAmplitudeSum(float persistence, int octaves)
+{
+    return octaves == 0 ? 0.0f : octaveAmplitudeSum(persistence, octaves - 1) + octaveAmplitude(persistence, octaves - 1);
+}
+
+// Adds octave Octave and the ones after it, one instantiation per octave so the sum is fully unrolled
+// with constant frequencies and amplitudes. The persistence is 1 / PersistenceInverse.
+template <int Octave, int Octaves, int PersistenceInverse>
+struct OctaveSum {
+    template <typename Noise>
+    static float add(Noise& noise, double x, double y, float total)
+    {
+        constexpr double frequency = static_cast<double>(1 << Octave);
+        constexpr float amplitude = octaveAmplitude(1.0f / PersistenceInverse, Octave);
+        return OctaveSum<Octave + 1, Octaves, PersistenceInverse>::add(noise, x, y, total + noise.noise(x * frequency, y * frequency) * amplitude);
+    }
+};
+
+template <int Octaves, int PersistenceInverse>
+struct OctaveSum<Octaves, Octaves, PersistenceInverse> {
+    template <typename Noise>
+    static float add(Noise&, double, double, float total) { return total; }
+};
+
+// Fixed preset of octaveNoise: octave count and persistence are compile-time constants, so the
+// normalization is folded and no loop or amplitude chain is left at runtime
+template <int Octaves, int PersistenceInverse, typename Noise>
+float octaveNoise(Noise& noise, double x, double y)
+{
+    static_assert(Octaves > 0 && Octaves < 31, "octave frequencies are powers of two held in an int");
+    constexpr float maxValue = octaveAmplitudeSum(1.0f / PersistenceInverse, Octaves);
+    return OctaveSum<0, Octaves, PersistenceInverse>::add(noise, x, y, 0.0f) / maxValue;
+}
+
+// Fewest leading octaves whose skipped tail changes the normalized result by at most maxError. Octaves finer
+// than two samples at sampleSpacing (noise units between samples) only alias and are skipped as well.
+// A maxError of 0 keeps every octave.
+int octavesForError(int octaves, float persistence, float sampleSpacing, float maxError);
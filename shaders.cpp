@@ -1,10 +1,36 @@
 #include "shaders.h"
 #include <GL/glew.h>
+#include <glm/gtc/type_ptr.hpp>
+#include <sys/stat.h>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+// Program binaries from earlier launches, relative to the working directory like ./resources
+static const char* SHADER_CACHE_DIR = "./shader_cache";
+
+// GLSL version and the per-frame camera and light data, shared by every program through one uniform
+// buffer. Prepended to each stage when it is compiled, so the block is declared identically everywhere.
+static const char* shaderPrelude = R"(#version 330 core
+    layout (std140) uniform FrameData {
+        mat4 view;        // View matrix for transforming world coordinates to camera coordinates
+        mat4 projection;  // Projection matrix for projecting 3D coordinates to 2D screen coordinates
+        vec4 viewPos;     // Camera position, w unused
+        vec4 lightPos;    // Position of light source, w unused
+        vec4 lightColor;  // Color of light source, w unused
+        float wireframe;  // 1 draws triangle edges over the shaded surface
+        float gridStep;   // Grid cells between neighbouring vertices at the current level of detail
+        float heightScale; // Terrain height scale, height textures hold unscaled heights
+        float heightOffset; // Height texture texels map to heightOffset + heightRange * texel
+        float heightRange;
+    };
+)";
 
-// Shader sources
+// Shader sources, compiled after shaderPrelude
 const char* normalVertexShaderSource = R"(
-    #version 330 core
-
     // Input vertex attributes
     layout (location = 0) in vec3 aPos;  // Position of the vertex
     layout (location = 1) in vec3 aNormal; // Normal vector of the vertex
@@ -14,8 +40,7 @@ const char* normalVertexShaderSource = R"(
 
     // Uniform variables
     uniform mat4 model;       // Model matrix for transforming vertex positions
-    uniform mat4 view;        // View matrix for transforming world coordinates to camera coordinates
-    uniform mat4 projection;  // Projection matrix for projecting 3D coordinates to 2D screen coordinates
+    uniform mat3 normalMatrix; // Inverse transpose of the model matrix, computed on the CPU
 
     void main()
     {
@@ -23,50 +48,38 @@ const char* normalVertexShaderSource = R"(
         gl_Position = projection * view * model * vec4(aPos, 1.0);
 
         // Calculate the transformed normal vector
-        Normal = mat3(transpose(inverse(model))) * aNormal;
+        Normal = normalMatrix * aNormal;
     }
 )";
 
 const char* normalGeometryShaderSource = R"(
-    #version 330 core
-
-    // Input type triangles
-    layout (triangles) in;
+    // Input type points, the terrain is drawn as GL_POINTS so every vertex arrives exactly once
+    layout (points) in;
 
     // Output type line strip
-    layout (line_strip, max_vertices = 6) out;
+    layout (line_strip, max_vertices = 2) out;
 
     // Input vertex attribute
-    in vec3 Normal[];  // Array of normal vectors for the input triangle
+    in vec3 Normal[];  // Normal vector of the input vertex
 
     const float MAGNITUDE = 0.4;  // Length of the normal lines
 
-    // Generates a line segment representing the normal at a vertex
-    void GenerateLine(int index)
+    void main()
     {
         // Emit the first vertex of the line
-        gl_Position = gl_in[index].gl_Position;
+        gl_Position = gl_in[0].gl_Position;
         EmitVertex();
 
         // Emit the second vertex of the line
-        gl_Position = gl_in[index].gl_Position + vec4(Normal[index], 0.0) * MAGNITUDE;
+        gl_Position = gl_in[0].gl_Position + vec4(Normal[0], 0.0) * MAGNITUDE;
         EmitVertex();
 
         // End the line primitive
         EndPrimitive();
     }
-
-    void main()
-    {
-        // Generate lines for each vertex of the input triangle
-        GenerateLine(0); // First vertex normal
-        GenerateLine(1); // Second vertex normal
-        GenerateLine(2); // Third vertex normal
-    }
 )";
 
 const char* normalFragmentShaderSource = R"(
-    #version 330 core
     out vec4 FragColor;
     void main()
     {
@@ -75,8 +88,6 @@ const char* normalFragmentShaderSource = R"(
 )";
 
 const char* vertexShaderSource = R"(
-    #version 330 core
-
     // Input vertex attributes
     layout (location = 0) in vec3 aPos;  // Position of the vertex
     layout (location = 1) in vec3 aNormal; // Normal vector of vertex
@@ -85,11 +96,11 @@ const char* vertexShaderSource = R"(
     out vec3 FragPos;  // Fragmented position for fragment shader
     out vec3 Normal;   // Normal vector for fragment shader
     out float Height;  // Height of the vertex
+    out vec2 GridPos;  // Grid coordinate for the wireframe edges
 
     // Uniform variables
     uniform mat4 model;       // Model matrix for transforming vertex positions
-    uniform mat4 view;        // View matrix for transforming world coordinates to camera coordinates
-    uniform mat4 projection;  // Projection matrix for projecting 3D coordinates to 2D screen coordinates
+    uniform mat3 normalMatrix; // Inverse transpose of the model matrix, computed on the CPU
 
     void main()
     {
@@ -97,10 +108,11 @@ const char* vertexShaderSource = R"(
         FragPos = vec3(model * vec4(aPos, 1.0));
 
         // Calculates transformed normal vector
-        Normal = mat3(transpose(inverse(model))) * aNormal;
+        Normal = normalMatrix * aNormal;
 
         // Extracts the height from the vertex position (y coordinate)
         Height = aPos.y;
+        GridPos = aPos.xz;
 
         // Calculate the final vertex position in clip space
         gl_Position = projection * view * vec4(FragPos, 1.0);
@@ -108,19 +120,111 @@ const char* vertexShaderSource = R"(
 )";
 
 const char* fragmentShaderSource = R"(
-    #version 330 core
-
     // Input attributes
     in vec3 FragPos;  // Fragmented position
     in vec3 Normal;   // Normal vector
     in float Height;  // Height of the fragment
+    in vec2 GridPos;  // Grid coordinate of the fragment
+
+    // Output attribute
+    out vec4 FragColor; // Color of fragment
+
+    // Calculates the color based on the height
+    vec3 heatmapColor(float t) {
+        // Color values for different heights
+        vec3 r = vec3(1.0, 0.0, 0.0); // Red
+        vec3 y = vec3(1.0, 1.0, 0.0); // Yellow
+        vec3 g = vec3(0.0, 1.0, 0.0); // Green
+        vec3 c = vec3(0.0, 1.0, 1.0); // Cyan
+        vec3 b = vec3(0.0, 0.0, 1.0); // Blue
+
+        // Interpolate colors based on the normalized height
+        if (t < 0.25) return mix(b, c, t * 4.0);
+        else if (t < 0.5) return mix(c, g, (t - 0.25) * 4.0);
+        else if (t < 0.75) return mix(g, y, (t - 0.5) * 4.0);
+        else return mix(y, r, (t - 0.75) * 4.0);
+    }
+
+    // Distance in pixels to the nearest triangle edge, every grid triangle is bounded by x, z and x + z lines
+    float wireframeEdge() {
+        vec3 g = vec3(GridPos, GridPos.x + GridPos.y) / gridStep;
+        vec3 d = abs(fract(g - 0.5) - 0.5) / fwidth(g);
+        return min(min(d.x, d.y), d.z);
+    }
+
+    void main()
+    {
+        // Normalizes the height to a [0, 1] range
+        float normalizedHeight = Height / heightScale + 0.5; // Follows the runtime height scale
+
+        // Calculate the base color for the heatmap
+        vec3 baseColor = heatmapColor(normalizedHeight);
+
+        // Ambient lighting
+        float ambientStrength = 0.1;
+        vec3 ambient = ambientStrength * lightColor.rgb;
+
+        // Diffuse lighting
+        vec3 norm = normalize(Normal);
+        vec3 lightDir = normalize(lightPos.xyz - FragPos);
+        float diff = max(dot(norm, lightDir), 0.0);
+        vec3 diffuse = diff * lightColor.rgb;
+
+        // Combines ambient and diffuse lighting with the base color
+        vec3 result = (ambient + diffuse) * baseColor;
+
+        // Darkens fragments near an edge, about one pixel wide, in the same pass as the shading
+        if (wireframe > 0.5) result *= smoothstep(0.5, 1.5, wireframeEdge());
+
+        // Sets the fragment color
+        FragColor = vec4(result, 1.0);
+    }
+)";
+
+const char* normalMapVertexShaderSource = R"(
+    // Input vertex attributes
+    layout (location = 0) in vec3 aPos;  // Position of the vertex, normals live in the normal map
+
+    // Output vertex attributes
+    out vec3 FragPos;   // Fragmented position for fragment shader
+    out vec2 TexCoord;  // Normal map coordinate for fragment shader
+    out float Height;   // Height of the vertex
+    out vec2 GridPos;   // Grid coordinate for the wireframe edges
+
+    // Uniform variables
+    uniform mat4 model;       // Model matrix for transforming vertex positions
+    uniform sampler2D normalMap; // RG8 normal texture, one texel per height sample
+
+    void main()
+    {
+        // Calculates transformed vertex position in world space
+        FragPos = vec3(model * vec4(aPos, 1.0));
+
+        // Grid x/z map to texel centers of the normal map
+        TexCoord = (aPos.xz + 0.5) / vec2(textureSize(normalMap, 0));
+
+        // Extracts the height from the vertex position (y coordinate)
+        Height = aPos.y;
+        GridPos = aPos.xz;
+
+        // Calculate the final vertex position in clip space
+        gl_Position = projection * view * vec4(FragPos, 1.0);
+    }
+)";
+
+const char* normalMapFragmentShaderSource = R"(
+    // Input attributes
+    in vec3 FragPos;   // Fragmented position
+    in vec2 TexCoord;  // Normal map coordinate
+    in float Height;   // Height of the fragment
+    in vec2 GridPos;   // Grid coordinate of the fragment
 
     // Output attribute
     out vec4 FragColor; // Color of fragment
 
     // Uniform variables
-    uniform vec3 lightPos;  // Position of light source
-    uniform vec3 lightColor; // Color of light source
+    uniform mat3 normalMatrix; // Inverse transpose of the model matrix, computed on the CPU
+    uniform sampler2D normalMap; // RG8 normal texture
 
     // Calculates the color based on the height
     vec3 heatmapColor(float t) {
@@ -138,114 +242,448 @@ const char* fragmentShaderSource = R"(
         else return mix(y, r, (t - 0.75) * 4.0);
     }
 
+    // Distance in pixels to the nearest triangle edge, every grid triangle is bounded by x, z and x + z lines
+    float wireframeEdge() {
+        vec3 g = vec3(GridPos, GridPos.x + GridPos.y) / gridStep;
+        vec3 d = abs(fract(g - 0.5) - 0.5) / fwidth(g);
+        return min(min(d.x, d.y), d.z);
+    }
+
     void main()
     {
         // Normalizes the height to a [0, 1] range
-        float normalizedHeight = (Height + 25.0) / 50.0; // Adjust based on terrain's height range
+        float normalizedHeight = Height / heightScale + 0.5; // Follows the runtime height scale
 
         // Calculate the base color for the heatmap
         vec3 baseColor = heatmapColor(normalizedHeight);
 
+        // Decodes the normal, y is reconstructed since heightfield normals always point up
+        vec2 nxz = texture(normalMap, TexCoord).rg * 2.0 - 1.0;
+        vec3 sampledNormal = vec3(nxz.x, sqrt(max(1.0 - dot(nxz, nxz), 0.0)), nxz.y);
+
         // Ambient lighting
         float ambientStrength = 0.1;
-        vec3 ambient = ambientStrength * lightColor;
+        vec3 ambient = ambientStrength * lightColor.rgb;
 
         // Diffuse lighting
-        vec3 norm = normalize(Normal);
-        vec3 lightDir = normalize(lightPos - FragPos);
+        vec3 norm = normalize(normalMatrix * sampledNormal);
+        vec3 lightDir = normalize(lightPos.xyz - FragPos);
         float diff = max(dot(norm, lightDir), 0.0);
-        vec3 diffuse = diff * lightColor;
+        vec3 diffuse = diff * lightColor.rgb;
 
         // Combines ambient and diffuse lighting with the base color
         vec3 result = (ambient + diffuse) * baseColor;
 
+        // Darkens fragments near an edge, about one pixel wide, in the same pass as the shading
+        if (wireframe > 0.5) result *= smoothstep(0.5, 1.5, wireframeEdge());
+
         // Sets the fragment color
         FragColor = vec4(result, 1.0);
     }
 )";
 
-// Shader functions
-GLuint createShaderProgram()
+const char* normalMapNormalVertexShaderSource = R"(
+    // Input vertex attributes
+    layout (location = 0) in vec3 aPos;  // Position of the vertex
+
+    // Output vertex attribute
+    out vec3 Normal; // Normal vector to be passed to the geometry shader
+
+    // Uniform variables
+    uniform mat4 model;       // Model matrix for transforming vertex positions
+    uniform mat3 normalMatrix; // Inverse transpose of the model matrix, computed on the CPU
+    uniform sampler2D normalMap; // RG8 normal texture
+
+    void main()
+    {
+        // Calculate the transformed vertex position in clip space
+        gl_Position = projection * view * model * vec4(aPos, 1.0);
+
+        // Vertices sit on integer grid coordinates, so the texel is fetched directly
+        vec2 nxz = texelFetch(normalMap, ivec2(aPos.xz), 0).rg * 2.0 - 1.0;
+        Normal = normalMatrix * vec3(nxz.x, sqrt(max(1.0 - dot(nxz, nxz), 0.0)), nxz.y);
+    }
+)";
+
+const char* heightTextureVertexShaderSource = R"(
+    // Input vertex attributes
+    layout (location = 0) in uvec2 aGrid;  // Grid coordinate of the vertex inside the shared patch
+
+    // Output vertex attributes
+    out vec3 FragPos;  // Fragmented position for fragment shader
+    out vec3 Normal;   // Normal vector for fragment shader
+    out float Height;  // Height of the vertex
+    out vec2 GridPos;  // Grid coordinate for the wireframe edges
+
+    // Uniform variables
+    uniform mat4 model;       // Model matrix for transforming vertex positions
+    uniform mat3 normalMatrix; // Inverse transpose of the model matrix, computed on the CPU
+    uniform sampler2D heightMap; // R16 quantized heightfield, one texel per sample
+    uniform int patchSize;    // Cells per side of the shared patch
+
+    void main()
+    {
+        // Places this instance's patch on the terrain grid, extra vertices past the edge collapse onto it
+        ivec2 size = textureSize(heightMap, 0);
+        int patchesX = (size.x - 2) / patchSize + 1;
+        ivec2 origin = ivec2(gl_InstanceID % patchesX, gl_InstanceID / patchesX) * patchSize;
+        ivec2 cell = min(origin + ivec2(aGrid), size - 1);
+
+        // Fetches the height of this vertex
+        float y = (heightOffset + heightRange * texelFetch(heightMap, cell, 0).r) * heightScale;
+
+        // Central differences like calculateNormal, flat along the border
+        vec3 n = vec3(0.0, 1.0, 0.0);
+        if (cell.x > 0 && cell.x < size.x - 1 && cell.y > 0 && cell.y < size.y - 1) {
+            float hL = (heightOffset + heightRange * texelFetch(heightMap, cell - ivec2(1, 0), 0).r) * heightScale;
+            float hR = (heightOffset + heightRange * texelFetch(heightMap, cell + ivec2(1, 0), 0).r) * heightScale;
+            float hD = (heightOffset + heightRange * texelFetch(heightMap, cell - ivec2(0, 1), 0).r) * heightScale;
+            float hU = (heightOffset + heightRange * texelFetch(heightMap, cell + ivec2(0, 1), 0).r) * heightScale;
+            n = normalize(vec3(hL - hR, 2.0, hD - hU));
+        }
+
+        // Calculates transformed vertex position and normal in world space
+        FragPos = vec3(model * vec4(float(cell.x), y, float(cell.y), 1.0));
+        Normal = normalMatrix * n;
+        Height = y;
+        GridPos = vec2(cell);
+
+        // Calculate the final vertex position in clip space
+        gl_Position = projection * view * vec4(FragPos, 1.0);
+    }
+)";
+
+const char* heightTextureNormalVertexShaderSource = R"(
+    // Input vertex attributes
+    layout (location = 0) in uvec2 aGrid;  // Grid coordinate of the vertex inside the shared patch
+
+    // Output vertex attribute
+    out vec3 Normal; // Normal vector to be passed to the geometry shader
+
+    // Uniform variables
+    uniform mat4 model;       // Model matrix for transforming vertex positions
+    uniform mat3 normalMatrix; // Inverse transpose of the model matrix, computed on the CPU
+    uniform sampler2D heightMap; // R16 quantized heightfield, one texel per sample
+    uniform int patchSize;    // Cells per side of the shared patch
+
+    void main()
+    {
+        // Same patch placement as the terrain vertex shader
+        ivec2 size = textureSize(heightMap, 0);
+        int patchesX = (size.x - 2) / patchSize + 1;
+        ivec2 origin = ivec2(gl_InstanceID % patchesX, gl_InstanceID / patchesX) * patchSize;
+        ivec2 cell = min(origin + ivec2(aGrid), size - 1);
+
+        float y = (heightOffset + heightRange * texelFetch(heightMap, cell, 0).r) * heightScale;
+        vec3 n = vec3(0.0, 1.0, 0.0);
+        if (cell.x > 0 && cell.x < size.x - 1 && cell.y > 0 && cell.y < size.y - 1) {
+            float hL = (heightOffset + heightRange * texelFetch(heightMap, cell - ivec2(1, 0), 0).r) * heightScale;
+            float hR = (heightOffset + heightRange * texelFetch(heightMap, cell + ivec2(1, 0), 0).r) * heightScale;
+            float hD = (heightOffset + heightRange * texelFetch(heightMap, cell - ivec2(0, 1), 0).r) * heightScale;
+            float hU = (heightOffset + heightRange * texelFetch(heightMap, cell + ivec2(0, 1), 0).r) * heightScale;
+            n = normalize(vec3(hL - hR, 2.0, hD - hU));
+        }
+
+        // Calculate the transformed vertex position in clip space
+        gl_Position = projection * view * model * vec4(float(cell.x), y, float(cell.y), 1.0);
+        Normal = normalMatrix * n;
+    }
+)";
+
+// Compiles a single shader stage
+static GLuint compileShader(GLenum type, const char* source)
 {
-    // Creates vertex shader object
-    GLuint vertexShader = glCreateShader(GL_VERTEX_SHADER);
+    // Creates the shader object
+    GLuint shader = glCreateShader(type);
 
-    // Sets the source code for the vertex shader
-    glShaderSource(vertexShader, 1, &vertexShaderSource, NULL);
+    // Sets the source code for the shader, the shared prelude first
+    const char* sources[2] = {shaderPrelude, source};
+    glShaderSource(shader, 2, sources, NULL);
 
-    // Compiles the vertex shader
-    glCompileShader(vertexShader);
+    // Compiles the shader
+    glCompileShader(shader);
 
-    // Creates a fragment shader object
-    GLuint fragmentShader = glCreateShader(GL_FRAGMENT_SHADER);
+    return shader;
+}
 
-    // Sets the source code for the fragment shader
-    glShaderSource(fragmentShader, 1, &fragmentShaderSource, NULL);
+// Prints the info log of a shader stage that failed to compile
+static bool checkShader(GLuint shader, const char* stage)
+{
+    GLint compiled = GL_FALSE;
+    glGetShaderiv(shader, GL_COMPILE_STATUS, &compiled);
+    if (!compiled) {
+        char log[1024];
+        glGetShaderInfoLog(shader, sizeof(log), NULL, log);
+        std::cerr << stage << " shader failed to compile:\n" << log << std::endl;
+    }
+    return compiled == GL_TRUE;
+}
 
-    // Compiles the fragment shader
-    glCompileShader(fragmentShader);
+// Prints the info log of a program that failed to link
+static bool checkProgram(GLuint program)
+{
+    GLint linked = GL_FALSE;
+    glGetProgramiv(program, GL_LINK_STATUS, &linked);
+    if (!linked) {
+        char log[1024];
+        glGetProgramInfoLog(program, sizeof(log), NULL, log);
+        std::cerr << "Shader program failed to link:\n" << log << std::endl;
+    }
+    return linked == GL_TRUE;
+}
 
-    // Creates a shader program object
-    GLuint shaderProgram = glCreateProgram();
+// Lets the driver compile and link on its own threads, queried once per context
+static bool enableParallelCompile()
+{
+    if (GLEW_KHR_parallel_shader_compile) {
+        glMaxShaderCompilerThreadsKHR(0xFFFFFFFF); // Driver picks the thread count
+        return true;
+    }
+    if (GLEW_ARB_parallel_shader_compile) {
+        glMaxShaderCompilerThreadsARB(0xFFFFFFFF);
+        return true;
+    }
+    return false;
+}
 
-    // Attaches the vertex and fragment shaders to the program
-    glAttachShader(shaderProgram, vertexShader);
-    glAttachShader(shaderProgram, fragmentShader);
+static bool parallelCompileEnabled()
+{
+    static const bool enabled = enableParallelCompile();
+    return enabled;
+}
 
-    // Links the shader program
-    glLinkProgram(shaderProgram);
+static bool programBinarySupported()
+{
+    return GLEW_VERSION_4_1 || GLEW_ARB_get_program_binary;
+}
 
-    // Deletes the vertex and fragment shader objects
-    glDeleteShader(vertexShader);
-    glDeleteShader(fragmentShader);
+// FNV-1a over one string, followed by a separator so adjacent strings can't alias
+static unsigned long long hashString(unsigned long long hash, const char* text)
+{
+    for (const char* c = text ? text : ""; *c; c++) {
+        hash ^= static_cast<unsigned char>(*c);
+        hash *= 1099511628211ULL;
+    }
+    hash ^= 0xFF;
+    hash *= 1099511628211ULL;
+    return hash;
+}
+
+// Binaries are only valid for the exact sources and driver that produced them
+static unsigned long long programCacheKey(const char* vertexSource, const char* geometrySource, const char* fragmentSource)
+{
+    unsigned long long hash = 14695981039346656037ULL;
+    hash = hashString(hash, shaderPrelude);
+    hash = hashString(hash, vertexSource);
+    hash = hashString(hash, geometrySource);
+    hash = hashString(hash, fragmentSource);
+    hash = hashString(hash, reinterpret_cast<const char*>(glGetString(GL_VENDOR)));
+    hash = hashString(hash, reinterpret_cast<const char*>(glGetString(GL_RENDERER)));
+    hash = hashString(hash, reinterpret_cast<const char*>(glGetString(GL_VERSION)));
+    return hash;
+}
+
+static std::string programCachePath(unsigned long long key)
+{
+    char name[32];
+    std::snprintf(name, sizeof(name), "/%016llx.bin", key);
+    return std::string(SHADER_CACHE_DIR) + name;
+}
+
+// Returns a linked program from the disk cache, or 0 on a miss or a binary the driver rejects
+static GLuint loadProgramBinary(unsigned long long key)
+{
+    if (!programBinarySupported()) return 0;
+
+    // File layout: binary format enum followed by the driver's blob
+    std::ifstream file(programCachePath(key), std::ios::binary);
+    GLenum format = 0;
+    if (!file.read(reinterpret_cast<char*>(&format), sizeof(format))) return 0;
+    std::vector<char> binary((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    if (binary.empty()) return 0;
+
+    GLuint program = glCreateProgram();
+    glProgramBinary(program, format, binary.data(), static_cast<GLsizei>(binary.size()));
+
+    // A driver update can invalidate old binaries even with a matching key, those are recompiled
+    GLint linked = GL_FALSE;
+    glGetProgramiv(program, GL_LINK_STATUS, &linked);
+    if (!linked) {
+        glDeleteProgram(program);
+        return 0;
+    }
+    return program;
+}
+
+// Writes a freshly linked program to the disk cache for the next launch
+static void saveProgramBinary(GLuint program, unsigned long long key)
+{
+    if (!programBinarySupported()) return;
+
+    GLint length = 0;
+    glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+    if (length <= 0) return;
+    std::vector<char> binary(length);
+    GLenum format = 0;
+    glGetProgramBinary(program, length, NULL, &format, binary.data());
+
+    mkdir(SHADER_CACHE_DIR, 0755); // Fails harmlessly when it already exists
+    std::ofstream file(programCachePath(key), std::ios::binary | std::ios::trunc);
+    if (!file) return;
+    file.write(reinterpret_cast<const char*>(&format), sizeof(format));
+    file.write(binary.data(), binary.size());
+}
+
+// Starts building a program from vertex, optional geometry, and fragment sources
+static PendingShaderProgram beginShaderProgram(const char* vertexSource, const char* geometrySource, const char* fragmentSource)
+{
+    PendingShaderProgram pending;
+    pending.cacheKey = programCacheKey(vertexSource, geometrySource, fragmentSource);
+
+    // A cached binary skips compiling entirely
+    pending.id = loadProgramBinary(pending.cacheKey);
+    if (pending.id) {
+        pending.fromCache = true;
+        return pending;
+    }
+
+    // Nothing below waits on the compiler when parallel compile is available
+    parallelCompileEnabled();
+    pending.shaders[0] = compileShader(GL_VERTEX_SHADER, vertexSource);
+    pending.shaders[1] = geometrySource ? compileShader(GL_GEOMETRY_SHADER, geometrySource) : 0;
+    pending.shaders[2] = compileShader(GL_FRAGMENT_SHADER, fragmentSource);
+
+    // Creates a shader program object and attaches the shaders to it
+    pending.id = glCreateProgram();
+    for (GLuint shader : pending.shaders)
+        if (shader) glAttachShader(pending.id, shader);
 
-    return shaderProgram;
+    // Links the shader program, keeping the binary retrievable for the cache
+    if (programBinarySupported()) glProgramParameteri(pending.id, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    glLinkProgram(pending.id);
+
+    return pending;
 }
 
-GLuint createNormalShaderProgram()
+// Looks up uniform locations once and points the FrameData block at the shared binding
+static ShaderProgram createProgramInterface(GLuint id)
 {
-    // Creates a vertex shader object
-    GLuint vertexShader = glCreateShader(GL_VERTEX_SHADER);
+    ShaderProgram program;
+    program.id = id;
+    program.model = glGetUniformLocation(id, "model");
+    program.normalMatrix = glGetUniformLocation(id, "normalMatrix");
+    program.patchSize = glGetUniformLocation(id, "patchSize");
+
+    GLuint frameBlock = glGetUniformBlockIndex(id, "FrameData");
+    if (frameBlock != GL_INVALID_INDEX) glUniformBlockBinding(id, frameBlock, FRAME_UNIFORM_BINDING);
+
+    // Texture paths always sample from unit 0, so the samplers are set once here
+    glUseProgram(id);
+    GLint normalMap = glGetUniformLocation(id, "normalMap");
+    GLint heightMap = glGetUniformLocation(id, "heightMap");
+    if (normalMap >= 0) glUniform1i(normalMap, 0);
+    if (heightMap >= 0) glUniform1i(heightMap, 0);
+    glUseProgram(0);
+
+    return program;
+}
 
-    // Sets the source code for the vertex shader
-    glShaderSource(vertexShader, 1, &normalVertexShaderSource, NULL);
+// Shader functions
+PendingShaderProgram createShaderProgram()
+{
+    return beginShaderProgram(vertexShaderSource, nullptr, fragmentShaderSource);
+}
 
-    // Compiles the vertex shader
-    glCompileShader(vertexShader);
+PendingShaderProgram createNormalShaderProgram()
+{
+    return beginShaderProgram(normalVertexShaderSource, normalGeometryShaderSource, normalFragmentShaderSource);
+}
 
-    // Creates a geometry shader object
-    GLuint geometryShader = glCreateShader(GL_GEOMETRY_SHADER);
+PendingShaderProgram createNormalMapShaderProgram()
+{
+    return beginShaderProgram(normalMapVertexShaderSource, nullptr, normalMapFragmentShaderSource);
+}
 
-    // Sets the source code for the geometry shader
-    glShaderSource(geometryShader, 1, &normalGeometryShaderSource, NULL);
+PendingShaderProgram createNormalMapNormalShaderProgram()
+{
+    return beginShaderProgram(normalMapNormalVertexShaderSource, normalGeometryShaderSource, normalFragmentShaderSource);
+}
 
-    // Compiles the geometry shader
-    glCompileShader(geometryShader);
+PendingShaderProgram createHeightTextureShaderProgram()
+{
+    return beginShaderProgram(heightTextureVertexShaderSource, nullptr, fragmentShaderSource);
+}
 
-    // Creates a fragment shader object
-    GLuint fragmentShader = glCreateShader(GL_FRAGMENT_SHADER);
+PendingShaderProgram createHeightTextureNormalShaderProgram()
+{
+    return beginShaderProgram(heightTextureNormalVertexShaderSource, normalGeometryShaderSource, normalFragmentShaderSource);
+}
 
-    // Sets the source code for the fragment shader
-    glShaderSource(fragmentShader, 1, &normalFragmentShaderSource, NULL);
+bool shaderProgramReady(const PendingShaderProgram& pending)
+{
+    // Without parallel compile the first status query simply blocks, so it counts as ready
+    if (pending.fromCache || !parallelCompileEnabled()) return true;
+    GLint completed = GL_FALSE;
+    glGetProgramiv(pending.id, GL_COMPLETION_STATUS_KHR, &completed);
+    return completed == GL_TRUE;
+}
 
-    // Compiles the fragment shader
-    glCompileShader(fragmentShader);
+ShaderProgram finishShaderProgram(PendingShaderProgram& pending)
+{
+    static const char* stageNames[3] = {"Vertex", "Geometry", "Fragment"};
+    GLuint id = pending.id;
+
+    if (!pending.fromCache) {
+        // Status is only queried now so the compile never stalls the caller early
+        bool linked = checkProgram(id);
+        for (int i = 0; i < 3; i++) {
+            if (!pending.shaders[i]) continue;
+            if (!linked) checkShader(pending.shaders[i], stageNames[i]);
+            glDeleteShader(pending.shaders[i]);
+        }
+
+        if (linked) {
+            saveProgramBinary(id, pending.cacheKey);
+        } else {
+            glDeleteProgram(id);
+            id = 0;
+        }
+    }
 
-    // Creates a shader program object
-    GLuint shaderProgram = glCreateProgram();
+    pending = PendingShaderProgram();
+    return id ? createProgramInterface(id) : ShaderProgram();
+}
 
-    // Attaches the vertex, geometry, and fragment shaders to the program
-    glAttachShader(shaderProgram, vertexShader);
-    glAttachShader(shaderProgram, geometryShader);
-    glAttachShader(shaderProgram, fragmentShader);
+void useShaderProgram(const ShaderProgram& program, const glm::mat4& model, const glm::mat3& normalMatrix)
+{
+    // Only the per-object uniforms are set here, camera and light come from the FrameData buffer
+    glUseProgram(program.id);
+    glUniformMatrix4fv(program.model, 1, GL_FALSE, glm::value_ptr(model));
+    if (program.normalMatrix >= 0) glUniformMatrix3fv(program.normalMatrix, 1, GL_FALSE, glm::value_ptr(normalMatrix));
+}
 
-    // Links the shader program
-    glLinkProgram(shaderProgram);
+void deleteShaderProgram(ShaderProgram& program)
+{
+    glDeleteProgram(program.id);
+    program = ShaderProgram();
+}
 
-    // Deletes the vertex, geometry, and fragment shader objects
-    glDeleteShader(vertexShader);
-    glDeleteShader(geometryShader);
-    glDeleteShader(fragmentShader);
+GLuint createFrameUniformBuffer()
+{
+    // Allocated once and bound to the shared binding for the lifetime of the program
+    GLuint ubo;
+    glGenBuffers(1, &ubo);
+    glBindBuffer(GL_UNIFORM_BUFFER, ubo);
+    glBufferData(GL_UNIFORM_BUFFER, sizeof(FrameUniforms), NULL, GL_DYNAMIC_DRAW);
+    glBindBufferBase(GL_UNIFORM_BUFFER, FRAME_UNIFORM_BINDING, ubo);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    return ubo;
+}
 
-    return shaderProgram;
+void updateFrameUniforms(GLuint ubo, const FrameUniforms& frame)
+{
+    // One upload per frame serves every program that draws this frame
+    glBindBuffer(GL_UNIFORM_BUFFER, ubo);
+    glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(FrameUniforms), &frame);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
 }
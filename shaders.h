@@ -1,5 +1,8 @@
 #pragma once
 #include <GL/glew.h> // for OpenGL types like GLuint
+#include <glm/glm.hpp>
+
+// Stage bodies only: the #version line and the FrameData block are prepended when a stage is compiled
 
 // Normal shader sources
 extern const char* normalVertexShaderSource;
@@ -10,6 +13,62 @@ extern const char* normalFragmentShaderSource;
 extern const char* vertexShaderSource;
 extern const char* fragmentShaderSource;
 
+// Normal map shader sources (positions in the VBO, normals in a texture)
+extern const char* normalMapVertexShaderSource;
+extern const char* normalMapFragmentShaderSource;
+extern const char* normalMapNormalVertexShaderSource;
+
+// Height texture shader sources (shared grid patch displaced in the vertex shader)
+extern const char* heightTextureVertexShaderSource;
+extern const char* heightTextureNormalVertexShaderSource;
+
+// Uniform buffer binding point of the FrameData block in every program
+const GLuint FRAME_UNIFORM_BINDING = 0;
+
+// Linked program with its uniform locations looked up once at link time, -1 when a program lacks one
+struct ShaderProgram {
+    GLuint id = 0;
+    GLint model = -1;
+    GLint normalMatrix = -1;
+    GLint patchSize = -1;
+};
+
+// Program whose compile and link may still be running on driver threads
+struct PendingShaderProgram {
+    GLuint id = 0;
+    GLuint shaders[3] = {0, 0, 0}; // Vertex, geometry, fragment, empty when loaded from the cache
+    unsigned long long cacheKey = 0;
+    bool fromCache = false;
+};
+
+// CPU copy of the std140 FrameData block, vec3s are padded to vec4
+struct FrameUniforms {
+    glm::mat4 view;
+    glm::mat4 projection;
+    glm::vec4 viewPos;
+    glm::vec4 lightPos;
+    glm::vec4 lightColor;
+    float wireframe = 0.0f;
+    float gridStep = 1.0f;
+    float heightScale = 50.0f;
+    float heightOffset = 0.0f; // Maps normalized R16 height texels back to unscaled heights
+    float heightRange = 1.0f;
+    float padding[3];     // std140 rounds the block up to a multiple of 16 bytes
+};
+
 // Optional: Function declarations for shader-related operations
-GLuint createShaderProgram();
-GLuint createNormalShaderProgram();
+// Programs come from the binary cache or start compiling, finishShaderProgram returns id 0 on errors
+PendingShaderProgram createShaderProgram();
+PendingShaderProgram createNormalShaderProgram();
+PendingShaderProgram createNormalMapShaderProgram();
+PendingShaderProgram createNormalMapNormalShaderProgram();
+PendingShaderProgram createHeightTextureShaderProgram();
+PendingShaderProgram createHeightTextureNormalShaderProgram();
+bool shaderProgramReady(const PendingShaderProgram& pending);
+ShaderProgram finishShaderProgram(PendingShaderProgram& pending);
+void useShaderProgram(const ShaderProgram& program, const glm::mat4& model, const glm::mat3& normalMatrix);
+void deleteShaderProgram(ShaderProgram& program);
+
+// Per-frame camera and light uniform buffer
+GLuint createFrameUniformBuffer();
+void updateFrameUniforms(GLuint ubo, const FrameUniforms& frame);
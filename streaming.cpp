@@ -0,0 +1,142 @@
+#include "streaming.h"
+#include <algorithm>
+#include <cstring>
+
+StreamBuffer::StreamBuffer() : buffer(0), mapped(nullptr), size(0), region(0), cursor(0)
+{
+}
+
+bool StreamBuffer::create(GLsizeiptr regionSize, int regionCount)
+{
+    // Immutable storage with persistent mapping needs GL 4.4 or ARB_buffer_storage
+    if (!(GLEW_VERSION_4_4 || GLEW_ARB_buffer_storage)) return false;
+
+    size = regionSize;
+    region = 0;
+    cursor = 0;
+    fences.assign(regionCount, nullptr);
+
+    // Mapped once for the lifetime of the buffer, coherent so no explicit flushes are needed
+    GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+    glGenBuffers(1, &buffer);
+    glBindBuffer(GL_COPY_READ_BUFFER, buffer);
+    glBufferStorage(GL_COPY_READ_BUFFER, size * regionCount, nullptr, flags);
+    mapped = static_cast<unsigned char*>(glMapBufferRange(GL_COPY_READ_BUFFER, 0, size * regionCount, flags));
+    if (!mapped) {
+        destroy();
+        return false;
+    }
+    return true;
+}
+
+void StreamBuffer::destroy()
+{
+    for (size_t i = 0; i < fences.size(); i++) {
+        if (fences[i]) glDeleteSync(fences[i]);
+    }
+    fences.clear();
+    if (buffer) {
+        glBindBuffer(GL_COPY_READ_BUFFER, buffer);
+        if (mapped) glUnmapBuffer(GL_COPY_READ_BUFFER);
+        glDeleteBuffers(1, &buffer);
+    }
+    buffer = 0;
+    mapped = nullptr;
+}
+
+void* StreamBuffer::allocate(GLsizeiptr bytes, GLintptr& offset, GLsizeiptr alignment)
+{
+    if (!mapped || bytes > size) return nullptr;
+
+    // Moves on when the request does not fit into what is left of this region
+    GLsizeiptr start = (cursor + alignment - 1) / alignment * alignment;
+    if (start + bytes > size) {
+        advance();
+        start = 0;
+    }
+
+    cursor = start + bytes;
+    offset = region * size + start;
+    return mapped + offset;
+}
+
+void StreamBuffer::advance()
+{
+    if (!mapped) return;
+
+    // Marks the end of the GPU commands reading the current region
+    fences[region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    region = (region + 1) % static_cast<int>(fences.size());
+    cursor = 0;
+
+    // Waits until the GPU is done with the region that is about to be overwritten
+    GLsync fence = fences[region];
+    if (!fence) return;
+    GLbitfield waitFlags = GL_SYNC_FLUSH_COMMANDS_BIT;
+    while (glClientWaitSync(fence, waitFlags, 1000000) == GL_TIMEOUT_EXPIRED) {
+        waitFlags = 0;
+    }
+    glDeleteSync(fence);
+    fences[region] = nullptr;
+}
+
+void streamToBuffer(StreamBuffer& stream, GLuint destination, GLintptr destinationOffset, const void* data, GLsizeiptr size)
+{
+    const unsigned char* bytes = static_cast<const unsigned char*>(data);
+
+    if (!stream.valid()) {
+        glBindBuffer(GL_COPY_WRITE_BUFFER, destination);
+        glBufferSubData(GL_COPY_WRITE_BUFFER, destinationOffset, size, bytes);
+        return;
+    }
+
+    // Large uploads are split into region-sized pieces, copied on the GPU
+    glBindBuffer(GL_COPY_READ_BUFFER, stream.id());
+    glBindBuffer(GL_COPY_WRITE_BUFFER, destination);
+    while (size > 0) {
+        GLsizeiptr piece = std::min(size, stream.regionSize());
+        GLintptr offset;
+        void* target = stream.allocate(piece, offset);
+        std::memcpy(target, bytes, piece);
+        glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, offset, destinationOffset, piece);
+
+        bytes += piece;
+        destinationOffset += piece;
+        size -= piece;
+    }
+}
+
+void copyFromStream(StreamBuffer& stream, GLintptr streamOffset, GLuint destination, GLintptr destinationOffset, GLsizeiptr size)
+{
+    glBindBuffer(GL_COPY_READ_BUFFER, stream.id());
+    glBindBuffer(GL_COPY_WRITE_BUFFER, destination);
+    glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, streamOffset, destinationOffset, size);
+}
+
+void streamToTexture(StreamBuffer& stream, GLuint texture, int width, int height, GLenum format, GLenum type, int bytesPerTexel, const void* data)
+{
+    const unsigned char* bytes = static_cast<const unsigned char*>(data);
+    GLsizeiptr rowBytes = static_cast<GLsizeiptr>(width) * bytesPerTexel;
+
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+    if (!stream.valid() || rowBytes > stream.regionSize()) {
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, height, format, type, bytes);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        return;
+    }
+
+    // Sources whole rows from the ring, as many as fit in one region at a time
+    int rowsPerBatch = static_cast<int>(stream.regionSize() / rowBytes);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, stream.id());
+    for (int row = 0; row < height; row += rowsPerBatch) {
+        int rows = std::min(rowsPerBatch, height - row);
+        GLintptr offset;
+        void* target = stream.allocate(rows * rowBytes, offset);
+        std::memcpy(target, bytes + row * rowBytes, rows * rowBytes);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, row, width, rows, format, type, (void*)offset);
+    }
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+}
@@ -0,0 +1,40 @@
+#pragma once
+#include <GL/glew.h>
+#include <vector>
+
+// Persistently mapped, coherent upload ring split into regions guarded by fences.
+// Data written through allocate() is visible to the GPU without a driver-side copy
+// or reallocation; the GPU then copies it into its destination or reads it in place.
+class StreamBuffer {
+public:
+    StreamBuffer();
+
+    // Returns false when glBufferStorage is unavailable, callers then fall back to glBufferSubData
+    bool create(GLsizeiptr regionSize, int regionCount = 3);
+    void destroy();
+    bool valid() const { return buffer != 0; }
+
+    // Reserves size bytes in the current region, moving to the next region when it is full.
+    // Returns nullptr if size is larger than one region.
+    void* allocate(GLsizeiptr size, GLintptr& offset, GLsizeiptr alignment = 4);
+    // Fences the current region and waits until the next one is no longer read by the GPU
+    void advance();
+
+    GLuint id() const { return buffer; }
+    GLsizeiptr regionSize() const { return size; }
+
+private:
+    GLuint buffer;
+    unsigned char* mapped;
+    GLsizeiptr size;        // Bytes per region
+    int region;             // Region currently being written
+    GLsizeiptr cursor;      // Write position inside the current region
+    std::vector<GLsync> fences;
+};
+
+// Copies data into a buffer through the ring with glCopyBufferSubData, or glBufferSubData without one
+void streamToBuffer(StreamBuffer& stream, GLuint destination, GLintptr destinationOffset, const void* data, GLsizeiptr size);
+// Copies bytes already written through allocate() from the ring into a buffer
+void copyFromStream(StreamBuffer& stream, GLintptr streamOffset, GLuint destination, GLintptr destinationOffset, GLsizeiptr size);
+// Uploads a full texture image through the ring as a pixel unpack buffer, in row batches
+void streamToTexture(StreamBuffer& stream, GLuint texture, int width, int height, GLenum format, GLenum type, int bytesPerTexel, const void* data);
@@ -4,92 +4,613 @@
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 #include "perlin.h"
+#include "kernels.h"
 #include <iostream>
 #include <cmath>
+#include <algorithm>
 
-void generateTerrain(std::vector<float>& vertices, std::vector<unsigned int>& indices, TerrainMode mode, const char* heightMapFile)
+// Seed 0 keeps the original behaviour of a random permutation per generation
+static PerlinNoise createNoise(unsigned int seed)
+{
+    return seed ? PerlinNoise(seed) : PerlinNoise();
+}
+
+static HashNoise createHashNoise(unsigned int seed)
+{
+    return seed ? HashNoise(seed) : HashNoise();
+}
+
+static SimplexNoise createSimplexNoise(unsigned int seed)
+{
+    return seed ? SimplexNoise(seed) : SimplexNoise();
+}
+
+static FixedNoise createFixedNoise(unsigned int seed)
+{
+    return seed ? FixedNoise(seed) : FixedNoise();
+}
+
+// Octaves and persistence of the terrain's fractal noise, the persistence is 1 / NOISE_PERSISTENCE_INVERSE
+const int NOISE_OCTAVES = 6;
+const int NOISE_PERSISTENCE_INVERSE = 2;
+const float NOISE_PERSISTENCE = 1.0f / NOISE_PERSISTENCE_INVERSE;
+
+// Range of normalized octave noise, spanned by the quantized heightfield. Image values span [0, 1].
+const float NOISE_HEIGHT_MIN = -1.0f;
+const float NOISE_HEIGHT_MAX = 1.0f;
+
+// Height sources for fillHeightField, evaluated by fillHeightRow into unscaled heights of grid points
+template <typename Noise>
+struct NoiseHeightSource {
+    Noise& noise;
+    float noiseScale;
+    int octaves; // Leading octaves actually evaluated, see octavesForError
+};
+
+// Fixed-point noise keeps the octave sum in integers. Grid coordinates times the float noise scale are
+// exact in double, so heights depend only on the seed, the parameters and the grid position.
+template <>
+struct NoiseHeightSource<FixedNoise> {
+    FixedNoise& noise;
+    float noiseScale;
+    int octaves;
+    std::uint32_t coordinate(int position) const { return FixedNoise::toFixed(static_cast<double>(position) * noiseScale); }
+    float operator()(int x, int z) const
+    {
+        std::uint32_t fx = coordinate(x);
+        std::uint32_t fz = coordinate(z);
+        std::int32_t value;
+        noise.octaveSample(&fx, &fz, &value, 1, NOISE_OCTAVES, octaves);
+        return static_cast<float>(value) / FIXED_NOISE_ONE;
+    }
+};
+
+// Noise source for samples step grid points apart, fine octaves are culled by the params' error bound
+template <typename Noise>
+static NoiseHeightSource<Noise> noiseSource(Noise& noise, const TerrainParams& params, int step)
+{
+    int octaves = octavesForError(NOISE_OCTAVES, NOISE_PERSISTENCE, params.noiseScale * step, params.octaveError);
+    return NoiseHeightSource<Noise>{noise, params.noiseScale, octaves};
+}
+
+struct ImageHeightSource {
+    const std::vector<float>& samples; // Image values in [0, 1], row-major
+    int width;
+    int height;
+    // Positions outside the image, such as the halo of an edge tile, repeat the nearest edge sample
+    float operator()(int x, int z) const
+    {
+        x = std::min(std::max(x, 0), width - 1);
+        z = std::min(std::max(z, 0), height - 1);
+        return samples[z * width + x];
+    }
+};
+
+// One row of count samples step grid points apart, starting at (x, z)
+template <typename HeightSource>
+static void fillHeightRow(float* row, int x, int z, int count, int step, const HeightSource& source)
+{
+    for (int i = 0; i < count; i++) row[i] = source(x + i * step, z);
+}
+
+// The octave count is fixed for a whole row, so it is checked once here: full detail takes the unrolled
+// preset, culled octave counts the runtime loop, and neither inner loop branches per sample
+template <typename Noise>
+static void fillHeightRow(float* row, int x, int z, int count, int step, const NoiseHeightSource<Noise>& source)
+{
+    double noiseZ = static_cast<double>(z) * source.noiseScale;
+    if (source.octaves == NOISE_OCTAVES) {
+        for (int i = 0; i < count; i++)
+            row[i] = octaveNoise<NOISE_OCTAVES, NOISE_PERSISTENCE_INVERSE>(source.noise, static_cast<double>(x + i * step) * source.noiseScale, noiseZ);
+        return;
+    }
+    for (int i = 0; i < count; i++)
+        row[i] = octaveNoise(source.noise, static_cast<double>(x + i * step) * source.noiseScale, noiseZ, NOISE_OCTAVES, NOISE_PERSISTENCE, 0, source.octaves);
+}
+
+// Fixed-point rows go through the batched kernels
+static void fillHeightRow(float* row, int x, int z, int count, int step, const NoiseHeightSource<FixedNoise>& source)
+{
+    std::vector<std::uint32_t> xs(count), zs(count, source.coordinate(z));
+    std::vector<std::int32_t> values(count);
+    for (int i = 0; i < count; i++) xs[i] = source.coordinate(x + i * step);
+    source.noise.octaveSample(xs.data(), zs.data(), values.data(), count, NOISE_OCTAVES, source.octaves);
+    for (int i = 0; i < count; i++) row[i] = static_cast<float>(values[i]) / FIXED_NOISE_ONE;
+}
+
+// Simplex rows run one octave of the whole row at a time through the batched kernels. Coordinates,
+// the double-precision accumulation and the normalization follow octaveNoise step for step, so the
+// heights equal the per-sample path bit for bit. Octave coordinates are formed in double and only
+// rounded to the kernels' float once scaled, like SimplexNoise::noise(double, double) does.
+static void fillHeightRow(float* row, int x, int z, int count, int step, const NoiseHeightSource<SimplexNoise>& source)
+{
+    std::vector<float> xs(count), zs(count), values(count);
+    double frequency = 1;
+    float amplitude = 1;
+    float maxValue = 0;
+    std::fill(row, row + count, 0.0f);
+    for (int octave = 0; octave < NOISE_OCTAVES; octave++) {
+        if (octave < source.octaves) {
+            for (int i = 0; i < count; i++) xs[i] = static_cast<float>(static_cast<double>(x + i * step) * source.noiseScale * frequency);
+            std::fill(zs.begin(), zs.end(), static_cast<float>(static_cast<double>(z) * source.noiseScale * frequency));
+            source.noise.noise(xs.data(), zs.data(), values.data(), count);
+            for (int i = 0; i < count; i++) row[i] += static_cast<double>(values[i]) * amplitude;
+        }
+        maxValue += amplitude;
+        amplitude *= NOISE_PERSISTENCE;
+        frequency *= 2;
+    }
+    for (int i = 0; i < count; i++) row[i] /= maxValue;
+}
+
+// Evaluates the source for a width x height region of samples step grid points apart, starting at
+// (originX, originZ), instantiated per source so the loop has no mode branch
+template <typename HeightSource>
+static bool fillHeightRegion(float* heights, int originX, int originZ, int width, int height, int step, const HeightSource& source, GenerationControl* control)
+{
+    for (int z = 0; z < height; z++) {
+        // Stops early when a newer request cancelled this one
+        if (control && control->cancelled) return false;
+
+        fillHeightRow(&heights[z * width], originX, originZ + z * step, width, step, source);
+    }
+    return true;
+}
+
+// Fills one float row at a time and quantizes it right away, so the float field never exists
+template <typename HeightSource>
+static bool fillHeightField(QuantizedHeightField& heights, const HeightSource& source, GenerationControl* control)
+{
+    std::vector<float> row(heights.width());
+    for (int z = 0; z < heights.height(); z++) {
+        // Reports progress once per row
+        if (control) control->progress = static_cast<float>(z) / heights.height();
+        if (!fillHeightRegion(row.data(), 0, z, heights.width(), 1, 1, source, control)) return false;
+        heights.quantizeRow(z, row.data());
+    }
+    return true;
+}
+
+// Cuts the grid into tiles and fills each one, halo included, independently of its neighbours
+template <typename HeightSource>
+static bool fillHeightTiles(std::vector<HeightTile>& tiles, int width, int height, int tileSize, int step, const HeightSource& source, GenerationControl* control)
+{
+    // Samples along each side at this step, the last one may fall short of the far edge
+    int samplesX = (width - 1) / step + 1;
+    int samplesZ = (height - 1) / step + 1;
+    int tilesX = (samplesX + tileSize - 1) / tileSize;
+    int tilesZ = (samplesZ + tileSize - 1) / tileSize;
+    tiles.assign(static_cast<size_t>(tilesX) * tilesZ, HeightTile());
+    for (int tz = 0; tz < tilesZ; tz++) {
+        for (int tx = 0; tx < tilesX; tx++) {
+            if (control) control->progress = static_cast<float>(tz * tilesX + tx) / tiles.size();
+
+            HeightTile& tile = tiles[tz * tilesX + tx];
+            tile.originX = tx * tileSize * step;
+            tile.originZ = tz * tileSize * step;
+            tile.step = step;
+            tile.width = std::min(tileSize, samplesX - tx * tileSize);
+            tile.height = std::min(tileSize, samplesZ - tz * tileSize);
+            tile.heights.resize(static_cast<size_t>(tile.stride()) * (tile.height + 2 * TILE_HALO));
+            if (!fillHeightRegion(tile.heights.data(), tile.originX - TILE_HALO * step, tile.originZ - TILE_HALO * step,
+                                  tile.stride(), tile.height + 2 * TILE_HALO, step, source, control))
+                return false;
+        }
+    }
+    return true;
+}
+
+// Grid dimensions for params, with the image loaded into samples in HEIGHTMAP_IMAGE mode
+static bool prepareHeightSource(const TerrainParams& params, std::vector<float>& samples, int& width, int& height)
 {
     // Sets dimensions for the terrains
-    int width = 200, height = 200;
-    // Creates vector for height map data
-    std::vector<float> heightMap;
-    PerlinNoise pn;
+    width = 200;
+    height = 200;
+    if (params.mode != TerrainMode::HEIGHTMAP_IMAGE) return true;
 
     // Error checking for height map file
-    if (mode == TerrainMode::HEIGHTMAP_IMAGE) {
-        if (heightMapFile == nullptr) {
-            std::cerr << "Height map file not provided for HEIGHTMAP_IMAGE mode." << std::endl;
-            return;
+    if (params.heightMapFile.empty()) {
+        std::cerr << "Height map file not provided for HEIGHTMAP_IMAGE mode." << std::endl;
+        return false;
+    }
+    loadHeightMap(params.heightMapFile.c_str(), samples, width, height);
+    if (samples.empty()) {
+        std::cerr << "Failed to load height map. Exiting." << std::endl;
+        return false;
+    }
+    return true;
+}
+
+// Largest error of a unit-amplitude Perlin octave upsampled with Catmull-Rom, times the cube of its
+// samples per wavelength. Measured on this noise: 0.039 at 4 samples per wavelength, 0.004 at 8.
+const float UPSAMPLE_ERROR_CONSTANT = 2.5f;
+// Coarsest grid an octave may be evaluated on, in grid points between samples
+const int MAX_UPSAMPLE_STEP = 32;
+
+// Catmull-Rom spline through p1 and p2, t in [0, 1]
+static float catmullRom(float p0, float p1, float p2, float p3, float t)
+{
+    return p1 + 0.5f * t * (p2 - p0 + t * (2.0f * p0 - 5.0f * p1 + 4.0f * p2 - p3 + t * (3.0f * (p1 - p2) + p3 - p0)));
+}
+
+// Adds octaves [firstOctave, endOctave) to heights, evaluated every step grid points and upsampled.
+// The coarse grid has one extra sample before and two after each axis for the spline's support.
+template <typename Noise>
+static bool addUpsampledOctaves(std::vector<float>& heights, int width, int height, Noise& noise, float noiseScale,
+                                int firstOctave, int endOctave, int step, GenerationControl* control)
+{
+    int coarseX = (width - 1) / step + 4;
+    int coarseZ = (height - 1) / step + 4;
+    std::vector<float> coarse(static_cast<size_t>(coarseX) * coarseZ);
+    for (int j = 0; j < coarseZ; j++) {
+        if (control && control->cancelled) return false;
+        for (int i = 0; i < coarseX; i++) {
+            double x = static_cast<double>((i - 1) * step) * noiseScale;
+            double z = static_cast<double>((j - 1) * step) * noiseScale;
+            coarse[j * coarseX + i] = octaveNoise(noise, x, z, NOISE_OCTAVES, NOISE_PERSISTENCE, firstOctave, endOctave);
+        }
+    }
+
+    // Separable: every coarse row is upsampled along x first, then the rows are blended along z
+    std::vector<float> rows(static_cast<size_t>(coarseZ) * width);
+    for (int j = 0; j < coarseZ; j++) {
+        const float* in = &coarse[j * coarseX];
+        for (int x = 0; x < width; x++) {
+            const float* p = in + x / step;
+            rows[j * width + x] = catmullRom(p[0], p[1], p[2], p[3], static_cast<float>(x % step) / step);
         }
-        loadHeightMap(heightMapFile, heightMap, width, height);
-        if (heightMap.empty()) {
-            std::cerr << "Failed to load height map. Exiting." << std::endl;
-            return;
+    }
+    for (int z = 0; z < height; z++) {
+        const float* p = &rows[(z / step) * width];
+        float t = static_cast<float>(z % step) / step;
+        float* out = &heights[z * width];
+        for (int x = 0; x < width; x++)
+            out[x] += catmullRom(p[x], p[width + x], p[2 * width + x], p[3 * width + x], t);
+    }
+    return true;
+}
+
+// Multigrid noise: each octave is evaluated on the coarsest power-of-two grid whose estimated upsampling
+// error stays within its share of params.multigridError, only the finest octaves run at every sample
+template <typename Noise>
+static bool fillNoiseMultigrid(std::vector<float>& heights, int width, int height, Noise& noise, const TerrainParams& params, GenerationControl* control)
+{
+    int octaves = octavesForError(NOISE_OCTAVES, NOISE_PERSISTENCE, params.noiseScale, params.octaveError);
+    float maxValue = 0.0f;
+    for (int i = 0; i < NOISE_OCTAVES; i++) maxValue += std::pow(NOISE_PERSISTENCE, static_cast<float>(i));
+
+    // Octaves get coarser steps the lower their frequency, so equal steps form a contiguous range
+    std::vector<int> steps(octaves, 1);
+    float budget = params.multigridError / octaves;
+    for (int i = 0; i < octaves; i++) {
+        float amplitude = std::pow(NOISE_PERSISTENCE, static_cast<float>(i)) / maxValue;
+        float frequency = std::ldexp(params.noiseScale, i); // Wavelengths per grid point
+        while (steps[i] < MAX_UPSAMPLE_STEP) { // Doubles the step while the doubled one stays within budget
+            float samplesPerWavelength = 1.0f / (frequency * steps[i] * 2);
+            if (amplitude * UPSAMPLE_ERROR_CONSTANT / std::pow(samplesPerWavelength, 3.0f) > budget) break;
+            steps[i] *= 2;
         }
     }
 
-    // Height and Noise scales for the terrain
-    float heightScale = 50.0f;  // Increase for more pronounced terrain
-    float noiseScale = 0.03f;   // Reduce for smoother terrain
+    heights.assign(static_cast<size_t>(width) * height, 0.0f);
+    int first = 0;
+    while (first < octaves && steps[first] > 1) {
+        int end = first + 1;
+        while (end < octaves && steps[end] == steps[first]) end++;
+        if (!addUpsampledOctaves(heights, width, height, noise, params.noiseScale, first, end, steps[first], control)) return false;
+        first = end;
+    }
 
-    // Generates terrain vertices and normals
-    for (int z = 0; z < height; z++)
-    {
-        // Calculates the height of the terrain
+    // The remaining fine octaves are added at every sample
+    for (int z = 0; z < height; z++) {
+        if (control) {
+            if (control->cancelled) return false;
+            control->progress = static_cast<float>(z) / height;
+        }
+        float* row = &heights[z * width];
         for (int x = 0; x < width; x++)
-        {
-            float y;
-            if (mode == TerrainMode::HEIGHTMAP_IMAGE) {
-                y = heightMap[z * width + x] * heightScale;
-            } else {
-                y = octavePerlin(pn, x * noiseScale, z * noiseScale, 6, 0.5) * heightScale;
+            row[x] += octaveNoise(noise, static_cast<double>(x) * params.noiseScale, static_cast<double>(z) * params.noiseScale, NOISE_OCTAVES, NOISE_PERSISTENCE, first, octaves);
+    }
+    return true;
+}
+
+template <typename Noise>
+static bool fillNoiseField(QuantizedHeightField& heights, Noise& noise, const TerrainParams& params, GenerationControl* control)
+{
+    if (params.multigridError <= 0.0f) return fillHeightField(heights, noiseSource(noise, params, 1), control);
+
+    // Upsampling blends whole coarse grids, so this path quantizes its rows once every octave is in
+    std::vector<float> field;
+    if (!fillNoiseMultigrid(field, heights.width(), heights.height(), noise, params, control)) return false;
+    for (int z = 0; z < heights.height(); z++) heights.quantizeRow(z, &field[static_cast<size_t>(z) * heights.width()]);
+    return true;
+}
+
+// Multigrid upsampling is float interpolation, so fixed-point noise always samples every octave to stay exact
+static bool fillNoiseField(QuantizedHeightField& heights, FixedNoise& noise, const TerrainParams& params, GenerationControl* control)
+{
+    return fillHeightField(heights, noiseSource(noise, params, 1), control);
+}
+
+// Loads or evaluates the unscaled heightfield, the mode is dispatched here once per generation
+static bool buildHeightField(QuantizedHeightField& heights, const TerrainParams& params, GenerationControl* control)
+{
+    std::vector<float> samples;
+    int width;
+    int height;
+    if (!prepareHeightSource(params, samples, width, height)) return false;
+    if (params.mode == TerrainMode::HEIGHTMAP_IMAGE) {
+        heights.reset(width, height, 0.0f, 1.0f);
+        return fillHeightField(heights, ImageHeightSource{samples, width, height}, control);
+    }
+
+    // The noise engine is dispatched here too, each one gets its own instantiation of the fill
+    heights.reset(width, height, NOISE_HEIGHT_MIN, NOISE_HEIGHT_MAX);
+    if (params.noiseEngine == NoiseEngine::HASH) {
+        HashNoise noise = createHashNoise(params.seed);
+        return fillNoiseField(heights, noise, params, control);
+    }
+    if (params.noiseEngine == NoiseEngine::SIMPLEX) {
+        SimplexNoise noise = createSimplexNoise(params.seed);
+        return fillNoiseField(heights, noise, params, control);
+    }
+    if (params.noiseEngine == NoiseEngine::FIXED) {
+        FixedNoise noise = createFixedNoise(params.seed);
+        return fillNoiseField(heights, noise, params, control);
+    }
+    PerlinNoise pn = createNoise(params.seed);
+    return fillNoiseField(heights, pn, params, control);
+}
+
+void generateHeightField(QuantizedHeightField& heights, const TerrainParams& params, GenerationControl* control)
+{
+    // Samples the source once per grid point, scaling is left to whoever builds positions and normals
+    if (!buildHeightField(heights, params, control)) heights.clear();
+}
+
+void generateTerrainData(TerrainData& data, RenderPath path, const TerrainParams& params, GenerationControl* control)
+{
+    data.normalMap = NormalMap();
+    data.quantizedHeights.clear();
+    data.tiles.clear();
+    data.heightScale = params.heightScale;
+
+    // Chunks are written from one tile each, generated at the chunk level of detail so coarse chunks
+    // evaluate only the octaves their spacing resolves
+    if (path == RenderPath::CHUNKED) {
+        int lod = std::max(0, std::min(params.chunkLod, MAX_CHUNK_LOD));
+        generateHeightTiles(data.tiles, data.width, data.height, CHUNK_SIZE >> lod, params, lod, control);
+        return;
+    }
+
+    // Every other path keeps only the 16-bit heightfield, meshes are expanded straight into GPU memory on upload
+    generateHeightField(data.quantizedHeights, params, control);
+    data.width = data.quantizedHeights.width();
+    data.height = data.quantizedHeights.height();
+    if (path == RenderPath::NORMAL_MAP && !data.quantizedHeights.empty())
+        generateNormalMap(BlockedHeightField(data.quantizedHeights), data.heightScale, data.normalMap);
+    if (control && !control->cancelled) control->progress = 1.0f;
+}
+
+void generateHeightTiles(std::vector<HeightTile>& tiles, int& width, int& height, int tileSize, const TerrainParams& params, int lod, GenerationControl* control)
+{
+    // One noise permutation or image serves every tile, so halos agree with the neighbouring interiors
+    std::vector<float> samples;
+    int step = 1 << lod;
+    bool filled = prepareHeightSource(params, samples, width, height);
+    if (filled && params.mode == TerrainMode::HEIGHTMAP_IMAGE) {
+        filled = fillHeightTiles(tiles, width, height, tileSize, step, ImageHeightSource{samples, width, height}, control);
+    } else if (filled && params.noiseEngine == NoiseEngine::HASH) {
+        HashNoise noise = createHashNoise(params.seed);
+        filled = fillHeightTiles(tiles, width, height, tileSize, step, noiseSource(noise, params, step), control);
+    } else if (filled && params.noiseEngine == NoiseEngine::SIMPLEX) {
+        SimplexNoise noise = createSimplexNoise(params.seed);
+        filled = fillHeightTiles(tiles, width, height, tileSize, step, noiseSource(noise, params, step), control);
+    } else if (filled && params.noiseEngine == NoiseEngine::FIXED) {
+        FixedNoise noise = createFixedNoise(params.seed);
+        filled = fillHeightTiles(tiles, width, height, tileSize, step, noiseSource(noise, params, step), control);
+    } else if (filled) {
+        PerlinNoise pn = createNoise(params.seed);
+        filled = fillHeightTiles(tiles, width, height, tileSize, step, noiseSource(pn, params, step), control);
+    }
+    if (!filled) tiles.clear();
+    else if (control && !control->cancelled) control->progress = 1.0f;
+}
+
+glm::vec3 tileNormal(const HeightTile& tile, int x, int z, float heightScale)
+{
+    // Central differences everywhere, edge samples read their missing neighbour from the halo.
+    // Neighbours are step grid cells away, so slopes are divided by the step.
+    float slopeScale = heightScale / tile.step;
+    return calculateNormal(tile.at(x - 1, z) * slopeScale, tile.at(x + 1, z) * slopeScale,
+                           tile.at(x, z - 1) * slopeScale, tile.at(x, z + 1) * slopeScale);
+}
+
+void writeTileVertices(const HeightTile& tile, int columns, int rows, float heightScale, float* vertices, bool withNormals)
+{
+    // Same layout as writeTerrainVertices, positions are in terrain grid coordinates
+    for (int z = 0; z < rows; z++) {
+        for (int x = 0; x < columns; x++) {
+            *vertices++ = static_cast<float>(tile.originX + x * tile.step);
+            *vertices++ = tile.at(x, z) * heightScale;
+            *vertices++ = static_cast<float>(tile.originZ + z * tile.step);
+            if (withNormals) {
+                glm::vec3 normal = tileNormal(tile, x, z, heightScale);
+                *vertices++ = normal.x;
+                *vertices++ = normal.y;
+                *vertices++ = normal.z;
             }
+        }
+    }
+}
 
-            // Adds vertex position to vertices vector
-            vertices.push_back(static_cast<float>(x));
-            vertices.push_back(y);
-            vertices.push_back(static_cast<float>(z));
-
-            // Normal calculation
-            glm::vec3 normal(0.0f, 1.0f, 0.0f);
-            if (x > 0 && x < width - 1 && z > 0 && z < height - 1) {
-                float hL, hR, hD, hU;
-                if (mode == TerrainMode::HEIGHTMAP_IMAGE) {
-                    hL = heightMap[z * width + (x - 1)] * heightScale;
-                    hR = heightMap[z * width + (x + 1)] * heightScale;
-                    hD = heightMap[(z - 1) * width + x] * heightScale;
-                    hU = heightMap[(z + 1) * width + x] * heightScale;
-                } else {
-                    hL = octavePerlin(pn, (x - 1) * noiseScale, z * noiseScale, 6, 0.5) * heightScale;
-                    hR = octavePerlin(pn, (x + 1) * noiseScale, z * noiseScale, 6, 0.5) * heightScale;
-                    hD = octavePerlin(pn, x * noiseScale, (z - 1) * noiseScale, 6, 0.5) * heightScale;
-                    hU = octavePerlin(pn, x * noiseScale, (z + 1) * noiseScale, 6, 0.5) * heightScale;
-                }
-                normal = calculateNormal(hL, hR, hD, hU);
+bool hasTerrain(const TerrainData& data)
+{
+    return !data.quantizedHeights.empty() || !data.tiles.empty();
+}
+
+size_t gridIndexCount(int width, int height)
+{
+    // Each band row is a strip of two indices per column plus the restart index
+    if (width < 2 || height < 2) return 0;
+    const int bandWidth = VERTEX_CACHE_SIZE / 2 - 1;
+    int cells = width - 1;
+    int bands = (cells + bandWidth - 1) / bandWidth;
+    return static_cast<size_t>(height - 1) * (2 * (cells + bands) + bands);
+}
+
+// Shared by the 16 and 32-bit variants, the restart index is the type's largest value
+template <typename Index>
+static void writeGridStrips(Index* indices, int width, int height)
+{
+    const Index restart = static_cast<Index>(RESTART_INDEX);
+
+    // Column bands narrow enough that a row's bottom vertices are still cached when the next row
+    // reuses them as its top, plain row-major order evicts them on wide grids. The first row of a
+    // band loads its top and bottom vertices interleaved, so both rows have to fit at once.
+    const int bandWidth = VERTEX_CACHE_SIZE / 2 - 1;
+    for (int x0 = 0; x0 < width - 1; x0 += bandWidth) {
+        int x1 = std::min(x0 + bandWidth, width - 1);
+        for (int z = 0; z < height - 1; z++) {
+            // One strip per band row, alternating top and bottom vertices gives the same
+            // triangles and winding as (topLeft, bottomLeft, topRight), (topRight, bottomLeft, bottomRight)
+            for (int x = x0; x <= x1; x++) {
+                *indices++ = static_cast<Index>(z * width + x);
+                *indices++ = static_cast<Index>((z + 1) * width + x);
             }
-            vertices.push_back(normal.x);
-            vertices.push_back(normal.y);
-            vertices.push_back(normal.z);
+            *indices++ = restart;
+        }
+    }
+}
+
+void writeGridIndices(unsigned int* indices, int width, int height)
+{
+    writeGridStrips(indices, width, height);
+}
+
+void writeGridIndices(unsigned short* indices, int width, int height)
+{
+    writeGridStrips(indices, width, height);
+}
+
+void generateGridIndices(std::vector<unsigned int>& indices, int width, int height)
+{
+    indices.resize(gridIndexCount(width, height));
+    if (!indices.empty()) writeGridIndices(indices.data(), width, height);
+}
+
+glm::vec3 heightFieldNormal(const BlockedHeightField& heights, int x, int z, float heightScale)
+{
+    // Central differences, flat along the border
+    if (x <= 0 || x >= heights.width() - 1 || z <= 0 || z >= heights.height() - 1) return glm::vec3(0.0f, 1.0f, 0.0f);
+    return calculateNormal(heights.at(x - 1, z) * heightScale, heights.at(x + 1, z) * heightScale,
+                           heights.at(x, z - 1) * heightScale, heights.at(x, z + 1) * heightScale);
+}
+
+void writeTerrainVertices(const BlockedHeightField& heights, float heightScale, float* vertices, bool withNormals)
+{
+    int width = heights.width();
+    int height = heights.height();
+    if (withNormals) {
+        // Position and normal from each sample's neighbourhood, visited block by block. Every vertex still
+        // lands at its row-major index, so the buffer is written in runs of one block row.
+        heights.forEachNeighbourhood([&](int x, int z, const HeightNeighbourhood& n) {
+            float* vertex = vertices + (static_cast<size_t>(z) * width + x) * 6;
+            glm::vec3 normal(0.0f, 1.0f, 0.0f); // Flat along the border, like heightFieldNormal
+            if (x > 0 && x < width - 1 && z > 0 && z < height - 1)
+                normal = calculateNormal(n.left * heightScale, n.right * heightScale, n.down * heightScale, n.up * heightScale);
+            vertex[0] = static_cast<float>(x);
+            vertex[1] = n.center * heightScale;
+            vertex[2] = static_cast<float>(z);
+            vertex[3] = normal.x;
+            vertex[4] = normal.y;
+            vertex[5] = normal.z;
+        });
+        return;
+    }
+
+    // Positions need no neighbours, so each row is converted back to row-major and written in order
+    std::vector<float> row(width);
+    for (int z = 0; z < height; z++) {
+        heights.toRowMajor(z, row.data());
+        for (int x = 0; x < width; x++) {
+            *vertices++ = static_cast<float>(x);
+            *vertices++ = row[x] * heightScale;
+            *vertices++ = static_cast<float>(z);
         }
     }
+}
 
-    // Generate indices
-    for (int z = 0; z < height - 1; z++) {
-        for (int x = 0; x < width - 1; x++) {
-            unsigned int topLeft = z * width + x;
-            unsigned int topRight = topLeft + 1;
-            unsigned int bottomLeft = (z + 1) * width + x;
-            unsigned int bottomRight = bottomLeft + 1;
+void generateNormalMap(const BlockedHeightField& heights, float heightScale, NormalMap& normalMap)
+{
+    int width = heights.width();
+    int height = heights.height();
+    normalMap.width = width;
+    normalMap.height = height;
+    normalMap.texels.resize(static_cast<size_t>(width) * height * 2);
+    const glm::vec3 flat(0.0f, 1.0f, 0.0f); // Border texels, like heightFieldNormal
+    const int mask = HEIGHT_BLOCK_SIZE - 1;
+    const Kernels& selected = kernels();
+    std::vector<float> rows(static_cast<size_t>(width) * 3);
+    unsigned char blockTexels[2 * HEIGHT_BLOCK_SIZE];
+    for (int z = 0; z < height; z++) {
+        unsigned char* texels = &normalMap.texels[static_cast<size_t>(z) * width * 2];
+        if (z == 0 || z == height - 1 || width < 3) {
+            for (int x = 0; x < width; x++) encodeNormal(flat, texels + 2 * x);
+            continue;
+        }
 
-            indices.push_back(topLeft);
-            indices.push_back(bottomLeft);
-            indices.push_back(topRight);
+        if ((z & mask) == 0 || (z & mask) == mask) {
+            // The row above or below lies in the next block row, so the three rows go back to row-major
+            for (int i = 0; i < 3; i++) heights.toRowMajor(z - 1 + i, &rows[static_cast<size_t>(i) * width]);
+            selected.encodeNormalRow(&rows[width], width, heightScale, texels);
+        } else {
+            // Samples 1 to HEIGHT_BLOCK_SIZE - 2 of each block row at once, every neighbour inside the block.
+            // Same result as heightFieldNormal and encodeNormal per texel.
+            for (int x0 = 0; x0 < width; x0 += HEIGHT_BLOCK_SIZE) {
+                int count = std::min(HEIGHT_BLOCK_SIZE, width - x0);
+                const float* row = heights.blockRow(x0 >> HEIGHT_BLOCK_SHIFT, z);
+                if (count == HEIGHT_BLOCK_SIZE) {
+                    selected.encodeNormalRow(row, HEIGHT_BLOCK_SIZE, heightScale, texels + 2 * x0);
+                } else {
+                    selected.encodeNormalRow(row, HEIGHT_BLOCK_SIZE, heightScale, blockTexels);
+                    std::copy(blockTexels + 2, blockTexels + 2 * count, texels + 2 * x0 + 2);
+                }
+            }
+            // The two samples either side of each block seam, from a 4x3 patch gathered across it
+            for (int x0 = HEIGHT_BLOCK_SIZE; x0 < width; x0 += HEIGHT_BLOCK_SIZE) {
+                float patch[12];
+                for (int i = 0; i < 12; i++) patch[i] = heights.clampedAt(x0 - 2 + (i & 3), z - 1 + (i >> 2));
+                selected.encodeNormalRow(patch + 4, 4, heightScale, texels + 2 * (x0 - 2));
+            }
+        }
+        encodeNormal(flat, texels);
+        encodeNormal(flat, texels + 2 * (width - 1));
+    }
+}
 
-            indices.push_back(topRight);
-            indices.push_back(bottomLeft);
-            indices.push_back(bottomRight);
+float averageCacheMissRatio(const std::vector<unsigned int>& indices, int cacheSize)
+{
+    // Simulates a FIFO post-transform cache, a hit doesn't refresh an entry's position
+    std::vector<unsigned int> cache(cacheSize, RESTART_INDEX);
+    size_t next = 0;
+    size_t misses = 0;
+    size_t triangles = 0;
+    size_t stripLength = 0;
+    for (unsigned int index : indices) {
+        // Every strip index after the first two completes a triangle
+        if (index == RESTART_INDEX) {
+            stripLength = 0;
+            continue;
         }
+        if (++stripLength >= 3) triangles++;
+
+        if (std::find(cache.begin(), cache.end(), index) != cache.end()) continue;
+        cache[next] = index;
+        next = (next + 1) % cache.size();
+        misses++;
     }
+    return triangles ? static_cast<float>(misses) / triangles : 0.0f;
 }
 
 void loadHeightMap(const char* filename, std::vector<float>& heightMap, int& width, int& height) {
@@ -123,3 +644,9 @@ void loadHeightMap(const char* filename, std::vector<float>& heightMap, int& wid
 glm::vec3 calculateNormal(float hL, float hR, float hD, float hU) {
     return glm::normalize(glm::vec3(hL - hR, 2.0f, hD - hU));
 }
+
+void encodeNormal(const glm::vec3& normal, unsigned char* texel) {
+    // Maps x and z from [-1, 1] to [0, 255], y is always positive on a heightfield so it is dropped
+    texel[0] = static_cast<unsigned char>(std::lround((normal.x * 0.5f + 0.5f) * 255.0f));
+    texel[1] = static_cast<unsigned char>(std::lround((normal.z * 0.5f + 0.5f) * 255.0f));
+}
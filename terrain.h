@@ -1,12 +1,127 @@
 #pragma once
 #include <glm/glm.hpp>
+#include <cstddef>
 #include <vector>
+#include <atomic>
+#include <string>
+#include "heightfield.h"
 
 enum class TerrainMode {
     PERLIN_NOISE,
     HEIGHTMAP_IMAGE
 };
 
-void generateTerrain(std::vector<float>& vertices, std::vector<unsigned int>& indices, TerrainMode mode, const char* heightMapFile = nullptr);
+// Gradient noise implementation behind the Perlin terrain
+enum class NoiseEngine {
+    PERLIN, // Classic permutation-table Perlin noise, repeats every 256 noise units
+    HASH,   // Table-free integer-hash gradient noise, no short period
+    SIMPLEX, // Simplex noise on the OpenSimplex2 lattice, 3 corners per sample
+    FIXED    // Integer Perlin noise, bit-identical heights on every machine for the same seed
+};
+
+// Generation inputs, changed at runtime from the keyboard or the command console
+struct TerrainParams {
+    TerrainMode mode = TerrainMode::PERLIN_NOISE;
+    std::string heightMapFile = "./resources/HeightMapIsland.jpg"; // Used in HEIGHTMAP_IMAGE mode
+    unsigned int seed = 0; // Noise seed, 0 picks a random one per generation
+    NoiseEngine noiseEngine = NoiseEngine::PERLIN;
+    float heightScale = 50.0f; // Increase for more pronounced terrain, changes only rescale the cached heightfield
+    float noiseScale = 0.03f;  // Reduce for smoother terrain, changes regenerate the noise
+    float octaveError = 0.0f;  // Error allowed from skipping fine noise octaves, relative to the noise range; 0 evaluates all
+    float multigridError = 0.0f; // Error allowed from upsampling coarse octaves, relative to the noise range; 0 samples every octave everywhere
+    int chunkLod = 0;          // CHUNKED only: chunks sample every 2^chunkLod-th grid point, changes regenerate
+};
+
+// How the terrain surface is stored on the GPU
+enum class RenderPath {
+    VERTEX_NORMALS, // Position and normal interleaved in the VBO (6 floats per vertex)
+    NORMAL_MAP,     // Positions only in the VBO, normals sampled from an RG8 texture
+    HEIGHT_TEXTURE, // Heights in an R16 texture, drawn as instances of one shared grid patch
+    CHUNKED         // Chunks suballocated from one VBO/EBO pool, culled and drawn with multi-draw indirect
+};
+
+// Two-component normal texture, one texel per height sample
+struct NormalMap {
+    int width = 0;
+    int height = 0;
+    std::vector<unsigned char> texels; // x and z of each normal packed into [0, 255], y is reconstructed
+};
+
+// Cells per side of a terrain chunk, each chunk is drawn from one HeightTile
+const int CHUNK_SIZE = 64;
+// Coarsest level of detail, one quad per chunk
+const int MAX_CHUNK_LOD = 6;
+
+// Samples on each side of a tile that belong to its neighbours. The second ring lets the far edge shared with
+// the next tile, which chunks draw from this tile, get the same normal the next tile computes for it.
+const int TILE_HALO = 2;
+
+// Independently generated part of the heightfield. The interior is surrounded by a halo ring of
+// samples owned by the neighbouring tiles, so normals along the tile edges use real neighbours.
+struct HeightTile {
+    int originX = 0; // Grid position of the first interior sample
+    int originZ = 0;
+    int width = 0;   // Interior samples, tiles on the far edges of the grid may be smaller
+    int height = 0;
+    int step = 1;    // Grid points between samples, 2^lod for coarse tiles
+    std::vector<float> heights; // Unscaled heights including the halo, row-major
+
+    int stride() const { return width + 2 * TILE_HALO; }
+    // Interior coordinates, negative ones and those from width/height on address the halo
+    float& at(int x, int z) { return heights[(z + TILE_HALO) * stride() + x + TILE_HALO]; }
+    float at(int x, int z) const { return heights[(z + TILE_HALO) * stride() + x + TILE_HALO]; }
+};
+
+// CPU-side terrain data. Meshes are not kept here, they are written straight into
+// mapped GPU buffers from the heightfield when uploaded.
+struct TerrainData {
+    NormalMap normalMap;          // NORMAL_MAP only
+    QuantizedHeightField quantizedHeights; // Unscaled heights of every path but CHUNKED, noise or image values
+    std::vector<HeightTile> tiles; // CHUNKED only, one per chunk at params.chunkLod, replaces quantizedHeights
+    float heightScale = 50.0f;    // Applied to the heights when positions and normals are built
+    int width = 0;
+    int height = 0;
+};
+
+// Shared with a worker thread: progress in [0, 1] and a cancellation flag, both checked once per row
+struct GenerationControl {
+    std::atomic<float> progress{0.0f};
+    std::atomic<bool> cancelled{false};
+};
+
+// Ends a triangle strip, GL_PRIMITIVE_RESTART_FIXED_INDEX uses the index type's largest value
+const unsigned int RESTART_INDEX = 0xFFFFFFFF;
+// Most vertices addressable by 16-bit indices, 0xFFFF itself is the restart index
+const size_t MAX_SHORT_INDEX_VERTICES = 0xFFFF;
+
+// Entries assumed for the GPU's post-transform vertex cache, kept small so the order suits most hardware
+const int VERTEX_CACHE_SIZE = 24;
+
+void generateTerrainData(TerrainData& data, RenderPath path, const TerrainParams& params, GenerationControl* control = nullptr);
+bool hasTerrain(const TerrainData& data);
+// Quantizes each row as it is generated, see QuantizedHeightField
+void generateHeightField(QuantizedHeightField& heights, const TerrainParams& params, GenerationControl* control = nullptr);
+// Generates the heightfield as tileSize x tileSize tiles in row-major tile order, each filling its own halo.
+// Halos past the edge of the grid extend the noise, or repeat the image's edge samples. Tiles at a coarser
+// lod sample every 2^lod-th grid point and skip the noise octaves that params.octaveError allows.
+void generateHeightTiles(std::vector<HeightTile>& tiles, int& width, int& height, int tileSize, const TerrainParams& params, int lod = 0, GenerationControl* control = nullptr);
+glm::vec3 tileNormal(const HeightTile& tile, int x, int z, float heightScale);
+// Same layout as writeTerrainVertices for columns x rows samples from the tile's first interior sample.
+// They may reach TILE_HALO - 1 samples into the far halo, e.g. the edge shared with the next tile.
+// Normals are continuous across tiles.
+void writeTileVertices(const HeightTile& tile, int columns, int rows, float heightScale, float* vertices, bool withNormals);
+// Triangle strips over the grid separated by RESTART_INDEX, ordered in column bands for post-transform cache reuse
+size_t gridIndexCount(int width, int height);
+void writeGridIndices(unsigned int* indices, int width, int height);
+void writeGridIndices(unsigned short* indices, int width, int height); // At most MAX_SHORT_INDEX_VERTICES vertices
+void generateGridIndices(std::vector<unsigned int>& indices, int width, int height);
+// Writes position (and normal when withNormals) for every grid point in row-major order, 3 or 6 floats per vertex
+void writeTerrainVertices(const BlockedHeightField& heights, float heightScale, float* vertices, bool withNormals);
+// Normal stencils read their neighbours through the blocked layout, see BlockedHeightField
+void generateNormalMap(const BlockedHeightField& heights, float heightScale, NormalMap& normalMap);
+glm::vec3 heightFieldNormal(const BlockedHeightField& heights, int x, int z, float heightScale);
+// Average cache miss ratio: vertex shader invocations per triangle, 0.5 is the ideal for a large grid
+float averageCacheMissRatio(const std::vector<unsigned int>& indices, int cacheSize = VERTEX_CACHE_SIZE);
 void loadHeightMap(const char* filename, std::vector<float>& heightMap, int& width, int& height);
 glm::vec3 calculateNormal(float hL, float hR, float hD, float hU);
+void encodeNormal(const glm::vec3& normal, unsigned char* texel);
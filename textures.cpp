@@ -0,0 +1,53 @@
+#include "textures.h"
+
+GLuint createNormalMapTexture(const NormalMap& normalMap)
+{
+    GLuint texture;
+    glGenTextures(1, &texture);
+    glBindTexture(GL_TEXTURE_2D, texture);
+
+    // Linear filtering interpolates between texel centers just like per-vertex normals would
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+    updateNormalMapTexture(texture, normalMap);
+    return texture;
+}
+
+void updateNormalMapTexture(GLuint texture, const NormalMap& normalMap)
+{
+    glBindTexture(GL_TEXTURE_2D, texture);
+
+    // Rows are 2 bytes per texel, so odd widths are not 4-byte aligned
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RG8, normalMap.width, normalMap.height, 0, GL_RG, GL_UNSIGNED_BYTE, normalMap.texels.data());
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+}
+
+GLuint createHeightTexture(const QuantizedHeightField& heights)
+{
+    GLuint texture;
+    glGenTextures(1, &texture);
+    glBindTexture(GL_TEXTURE_2D, texture);
+
+    // Heights are read with texelFetch, so no filtering is needed
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+    updateHeightTexture(texture, heights);
+    return texture;
+}
+
+void updateHeightTexture(GLuint texture, const QuantizedHeightField& heights)
+{
+    glBindTexture(GL_TEXTURE_2D, texture);
+
+    // Rows are 2 bytes per texel, so odd widths are not 4-byte aligned
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_R16, heights.width(), heights.height(), 0, GL_RED, GL_UNSIGNED_SHORT, heights.data());
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+}
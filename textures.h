@@ -0,0 +1,13 @@
+#pragma once
+#include <GL/glew.h>
+#include "terrain.h"
+
+// Creates an RG8 texture from the generated normal map
+GLuint createNormalMapTexture(const NormalMap& normalMap);
+// Replaces the contents of an existing normal map texture (used on regeneration)
+void updateNormalMapTexture(GLuint texture, const NormalMap& normalMap);
+
+// Creates an R16 texture holding the quantized heightfield, texels are normalized to [0, 1] of its range
+GLuint createHeightTexture(const QuantizedHeightField& heights);
+// Replaces the contents of an existing height texture, regeneration is just this upload
+void updateHeightTexture(GLuint texture, const QuantizedHeightField& heights);
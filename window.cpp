@@ -1,5 +1,6 @@
 #include "window.h"
 #include <iostream>
+#include <algorithm>
 #include <glm/gtc/matrix_transform.hpp>
 
 // Define external variables
@@ -8,6 +9,7 @@ glm::vec3 cameraFront(0.0f, 0.0f, -1.0f);
 glm::vec3 cameraUp(0.0f, 1.0f, 0.0f);
 bool wireframeMode = false;
 bool renderNormals = false;
+RenderPath renderPath = RenderPath::VERTEX_NORMALS;
 float yaw = -90.0f;
 float pitch = 0.0f;
 float lastX = 400, lastY = 300;
@@ -22,13 +24,20 @@ GLFWwindow* initializeWindow()
         return nullptr;
     }
 
-    // Set OpenGL version and core profile
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+    // Set OpenGL version and core profile, 4.3 enables multi-draw indirect for chunked terrain
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
     glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
     glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
 
     GLFWwindow* window = glfwCreateWindow(800, 600, "Terrain Renderer", NULL, NULL);
     if (!window)
+    {
+        // Falls back to the 3.3 baseline on older drivers
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+        window = glfwCreateWindow(800, 600, "Terrain Renderer", NULL, NULL);
+    }
+    if (!window)
     {
         std::cerr << "Failed to create GLFW window" << std::endl;
         glfwTerminate();
@@ -45,13 +54,17 @@ GLFWwindow* initializeWindow()
 
     glEnable(GL_DEPTH_TEST);
 
+    // Terrain meshes are triangle strips separated by the index type's largest value
+    if (GLEW_VERSION_4_3) glEnable(GL_PRIMITIVE_RESTART_FIXED_INDEX);
+    else glEnable(GL_PRIMITIVE_RESTART);
+
     glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
     glfwSetCursorPosCallback(window, mouse_callback);
 
     return window;
 }
 
-void processInput(GLFWwindow *window, TerrainMode& mode, std::vector<float>& vertices, std::vector<unsigned int>& indices, GLuint& VAO, GLuint& VBO, GLuint& EBO)
+void processInput(GLFWwindow *window, TerrainParams& params, TerrainWorker& worker)
 {
     float cameraSpeed = 0.9f;
 
@@ -74,11 +87,7 @@ void processInput(GLFWwindow *window, TerrainMode& mode, std::vector<float>& ver
         static double lastToggleTime = 0.0;
         double currentTime = glfwGetTime();
         if (currentTime - lastToggleTime > 0.2) {
-            wireframeMode = !wireframeMode;
-            if(wireframeMode)
-                glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
-            else
-                glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+            wireframeMode = !wireframeMode; // Edges are drawn by the terrain fragment shader
             lastToggleTime = currentTime;
         }
     }
@@ -95,45 +104,94 @@ void processInput(GLFWwindow *window, TerrainMode& mode, std::vector<float>& ver
         }
     }
 
-    // Toggle terrain mode
+    // Height scale, rescales the cached heightfield instead of regenerating
+    if (glfwGetKey(window, GLFW_KEY_RIGHT_BRACKET) == GLFW_PRESS || glfwGetKey(window, GLFW_KEY_LEFT_BRACKET) == GLFW_PRESS)
+    {
+        static double lastScaleTime = 0.0;
+        double currentTime = glfwGetTime();
+        if (currentTime - lastScaleTime > 0.1) {
+            if (glfwGetKey(window, GLFW_KEY_RIGHT_BRACKET) == GLFW_PRESS) params.heightScale *= 1.1f;
+            else params.heightScale /= 1.1f;
+            lastScaleTime = currentTime;
+        }
+    }
+
+    // Toggle terrain mode, generated on the worker thread while the current terrain keeps rendering
     static bool tKeyPressed = false;
     if (glfwGetKey(window, GLFW_KEY_T) == GLFW_PRESS) {
         if (!tKeyPressed) {
             tKeyPressed = true;
-            if (mode == TerrainMode::PERLIN_NOISE) {
-                mode = TerrainMode::HEIGHTMAP_IMAGE;
-                std::cout << "Switched to height map mode. Enter image path: ";
-                std::string filename;
-                std::cin >> filename;
-                vertices.clear();
-                indices.clear();
-                generateTerrain(vertices, indices, mode, filename.c_str());
+            if (params.mode == TerrainMode::PERLIN_NOISE) {
+                params.mode = TerrainMode::HEIGHTMAP_IMAGE;
+                std::cout << "Switching to height map mode: " << params.heightMapFile << std::endl;
             } else {
-                mode = TerrainMode::PERLIN_NOISE;
-                vertices.clear();
-                indices.clear();
-                generateTerrain(vertices, indices, mode);
+                params.mode = TerrainMode::PERLIN_NOISE;
+                std::cout << "Switching to Perlin noise mode" << std::endl;
             }
-
-            // Rebind the vertex and index buffers
-            glBindVertexArray(VAO);
-            glBindBuffer(GL_ARRAY_BUFFER, VBO);
-            glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(float), vertices.data(), GL_STATIC_DRAW);
-
-            glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-            glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), indices.data(), GL_STATIC_DRAW);
-
-            // Reset vertex attribute pointers
-            glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (void*)0);
-            glEnableVertexAttribArray(0);
-            glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (void*)(3 * sizeof(float)));
-            glEnableVertexAttribArray(1);
+            worker.start(renderPath, params);
         }
     } else {
         tKeyPressed = false;
     }
 }
 
+void processCommands(GLFWwindow* window, CommandConsole& console, TerrainParams& params, TerrainWorker& worker)
+{
+    ConsoleCommand command;
+    bool regenerate = false;
+
+    // Drains everything posted since the last frame, several commands cost one regeneration
+    while (console.poll(command)) {
+        switch (command.type) {
+        case CommandType::LOAD:
+            params.mode = TerrainMode::HEIGHTMAP_IMAGE;
+            params.heightMapFile = command.argument;
+            regenerate = true;
+            break;
+        case CommandType::SEED:
+            params.seed = static_cast<unsigned int>(command.value);
+            regenerate = regenerate || params.mode == TerrainMode::PERLIN_NOISE;
+            break;
+        case CommandType::MODE:
+            params.mode = command.argument == "image" ? TerrainMode::HEIGHTMAP_IMAGE : TerrainMode::PERLIN_NOISE;
+            regenerate = true;
+            break;
+        case CommandType::ENGINE:
+            if (command.argument == "hash") params.noiseEngine = NoiseEngine::HASH;
+            else if (command.argument == "simplex") params.noiseEngine = NoiseEngine::SIMPLEX;
+            else if (command.argument == "fixed") params.noiseEngine = NoiseEngine::FIXED;
+            else params.noiseEngine = NoiseEngine::PERLIN;
+            regenerate = regenerate || params.mode == TerrainMode::PERLIN_NOISE;
+            break;
+        case CommandType::LOD:
+            if (renderPath != RenderPath::CHUNKED) {
+                std::cout << "lod only applies to the --chunked render path" << std::endl;
+                break;
+            }
+            // Coarse chunks come from coarse tiles, regenerated with the octaves their spacing resolves
+            params.chunkLod = std::max(0, std::min(static_cast<int>(command.value), MAX_CHUNK_LOD));
+            std::cout << "Chunk LOD " << params.chunkLod << std::endl;
+            regenerate = true;
+            break;
+        case CommandType::HEIGHT:
+            params.heightScale = command.scale; // Applied by the render loop from the cached heightfield
+            break;
+        case CommandType::NOISE:
+            params.noiseScale = command.scale;
+            regenerate = regenerate || params.mode == TerrainMode::PERLIN_NOISE;
+            break;
+        case CommandType::HELP:
+            printCommandHelp();
+            break;
+        case CommandType::QUIT:
+            glfwSetWindowShouldClose(window, GLFW_TRUE);
+            break;
+        }
+    }
+
+    if (regenerate) worker.start(renderPath, params);
+}
+
 void mouse_callback(GLFWwindow* window, double xpos, double ypos)
 {
     (void)window; // suppresses unused parameter warning
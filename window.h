@@ -4,10 +4,14 @@
 #include <GLFW/glfw3.h>
 #include <glm/glm.hpp>
 #include "terrain.h" // Include this if TerrainMode is defined here
+#include "worker.h"
+#include "console.h"
 
 // Function declarations
 GLFWwindow* initializeWindow();
-void processInput(GLFWwindow *window, TerrainMode& mode, std::vector<float>& vertices, std::vector<unsigned int>& indices, GLuint& VAO, GLuint& VBO, GLuint& EBO);
+void processInput(GLFWwindow *window, TerrainParams& params, TerrainWorker& worker);
+// Applies commands posted by the console thread, called once per frame on the render thread
+void processCommands(GLFWwindow* window, CommandConsole& console, TerrainParams& params, TerrainWorker& worker);
 void mouse_callback(GLFWwindow* window, double xpos, double ypos);
 
 // External variable declarations
@@ -16,6 +20,7 @@ extern glm::vec3 cameraFront;
 extern glm::vec3 cameraUp;
 extern bool wireframeMode;
 extern bool renderNormals;
+extern RenderPath renderPath;
 extern float yaw;
 extern float pitch;
 extern float lastX, lastY;
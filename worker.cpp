@@ -0,0 +1,80 @@
+#include "worker.h"
+#include <iostream>
+
+TerrainWorker::TerrainWorker()
+{
+}
+
+TerrainWorker::~TerrainWorker()
+{
+    cancel();
+    joinRetired(true);
+}
+
+void TerrainWorker::run(std::shared_ptr<Job> job)
+{
+    generateTerrainData(job->result, job->path, job->params, &job->control);
+    job->finished = true;
+}
+
+void TerrainWorker::start(RenderPath path, const TerrainParams& params)
+{
+    cancel();
+
+    current.job = std::make_shared<Job>();
+    current.job->path = path;
+    current.job->params = params;
+    current.thread = std::thread(&TerrainWorker::run, current.job);
+}
+
+void TerrainWorker::cancel()
+{
+    if (!current.job) return;
+
+    // Never joins here: the thread may still be inside an image load, so it is retired instead
+    current.job->control.cancelled = true;
+    retired.push_back(std::move(current));
+    current = Task();
+}
+
+bool TerrainWorker::busy() const
+{
+    return current.job && !current.job->finished;
+}
+
+float TerrainWorker::progress() const
+{
+    return current.job ? current.job->control.progress.load() : 0.0f;
+}
+
+void TerrainWorker::joinRetired(bool wait)
+{
+    for (size_t i = 0; i < retired.size();) {
+        if (wait || retired[i].job->finished) {
+            retired[i].thread.join();
+            retired.erase(retired.begin() + i);
+        } else {
+            i++;
+        }
+    }
+}
+
+bool TerrainWorker::poll(TerrainData& data)
+{
+    joinRetired(false);
+    if (!current.job || !current.job->finished) return false;
+
+    // The thread has finished, so joining does not block
+    current.thread.join();
+    std::shared_ptr<Job> job = current.job;
+    current = Task();
+
+    // A failed load keeps the old terrain on screen
+    if (!hasTerrain(job->result)) {
+        std::cerr << "Terrain regeneration failed, keeping the current terrain." << std::endl;
+        return false;
+    }
+
+    std::swap(data, job->result);
+    return true;
+}
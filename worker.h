@@ -0,0 +1,41 @@
+#pragma once
+#include <memory>
+#include <thread>
+#include <vector>
+#include "terrain.h"
+
+// Regenerates terrain on a background thread while the old mesh keeps rendering.
+// Results are only handed over on the GL thread through poll().
+class TerrainWorker {
+public:
+    TerrainWorker();
+    ~TerrainWorker();
+
+    // Starts a new generation, cancelling the one still running
+    void start(RenderPath path, const TerrainParams& params);
+    void cancel();
+    bool busy() const;
+    float progress() const;
+
+    // Moves a finished result into data, returns false while nothing new is ready
+    bool poll(TerrainData& data);
+
+private:
+    struct Job {
+        GenerationControl control;
+        std::atomic<bool> finished{false};
+        TerrainData result;
+        RenderPath path;
+        TerrainParams params;
+    };
+    struct Task {
+        std::shared_ptr<Job> job;
+        std::thread thread;
+    };
+
+    static void run(std::shared_ptr<Job> job);
+    void joinRetired(bool wait);
+
+    Task current;
+    std::vector<Task> retired; // Cancelled tasks, joined once they notice the cancellation
+};